@@ -0,0 +1,420 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026
+ * File : can_library_bench.cpp
+ *
+ * Receive path microbenchmark. Drives CanInterface::received_can_packet
+ * with synthetic J1939 traffic against a stub callback and reports
+ * throughput, latency percentiles and heap allocations per packet.
+ *
+ * usage: can_library_bench [packets_per_mix] [mix]
+ */
+
+#include "can_library.hpp"
+#include "transport_protocol/can_transport_defines.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace brt::can;
+
+static std::atomic_uint64_t _allocations(0);
+static CanBusHandle         _bus = INVALID_CAN_BUS_HANDLE;
+
+void* operator new(size_t size)
+{
+  _allocations++;
+  void* ptr = ::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { ::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { ::free(ptr); }
+
+#define BENCH_BUS_NAME                      "can0"
+#define BENCH_LOCAL_ADDRESS                 (0x80)
+#define BENCH_REMOTE_FIRST                  (0x10)
+#define BENCH_REMOTE_COUNT                  (16)
+#define BENCH_CLAIM_FIRST                   (0x40)
+#define BENCH_CLAIM_COUNT                   (32)
+#define BENCH_TP_MESSAGE_SIZE               (100)
+#define BENCH_BURST_SIZE                    (32)
+
+/**
+ * \class StubCallback
+ *
+ * Host side of the library with a manually driven clock. Outgoing packets
+ * are collected, so the harness can confirm them outside of the measured path.
+ */
+class StubCallback : public CanInterface::Callback
+{
+public:
+  StubCallback() : _time_ns(0), _sent(0), _received(0) {}
+  virtual ~StubCallback() {}
+
+  virtual uint64_t                get_time_tick_nanoseconds() const { return _time_ns; }
+  virtual void                    message_received(const CanMessagePtr&,const LocalECUPtr&,const RemoteECUPtr&,const ConstantString&)
+  { _received++; }
+
+  virtual void                    send_can_packet(const ConstantString&, const CanPacket& packet)
+  {
+    _sent++;
+    _pending.push_back(packet.unique_id());
+  }
+
+  virtual void                    on_remote_ecu(const RemoteECUPtr&,const ConstantString&) {}
+
+  virtual uint32_t                create_mutex()
+  {
+    std::lock_guard<std::mutex> l(_mutex_lock);
+    _mutexes.emplace_back(new std::recursive_mutex());
+    return static_cast<uint32_t>(_mutexes.size() - 1);
+  }
+
+  virtual void                    delete_mutex(uint32_t) {}
+  virtual void                    lock_mutex(uint32_t mutex_id) { mutex(mutex_id)->lock(); }
+  virtual void                    unlock_mutex(uint32_t mutex_id) { mutex(mutex_id)->unlock(); }
+  virtual uint32_t                get_current_thread_id() const
+  { return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())); }
+
+          void                    advance(uint64_t ms) { _time_ns += ms * 1000000llu; }
+
+          void                    confirm_all(CanInterface* can)
+          {
+            std::vector<uint64_t> pending;
+            pending.swap(_pending);
+            for (auto id : pending)
+              can->can_packet_confirm(id, eMessageSent);
+          }
+
+  uint64_t                        _time_ns;
+  uint64_t                        _sent;
+  uint64_t                        _received;
+
+private:
+  std::recursive_mutex*           mutex(uint32_t mutex_id)
+  {
+    std::lock_guard<std::mutex> l(_mutex_lock);
+    return _mutexes[mutex_id].get();
+  }
+
+  std::mutex                      _mutex_lock;
+  std::vector<std::unique_ptr<std::recursive_mutex>> _mutexes;
+  std::vector<uint64_t>           _pending;
+};
+
+/**
+ * \struct Stats
+ *
+ */
+struct Stats
+{
+  Stats() : _packets(0), _allocations(0), _total_ns(0) {}
+
+  std::vector<uint64_t>           _latency;
+  uint64_t                        _packets;
+  uint64_t                        _allocations;
+  uint64_t                        _total_ns;
+};
+
+/**
+ * \fn  timed_receive
+ *
+ * @param  can : CanInterface*
+ * @param  packet : const CanPacket&
+ * @param  stats : Stats&
+ */
+static void timed_receive(CanInterface* can, const CanPacket& packet, Stats& stats)
+{
+  uint64_t allocs = _allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+
+  can->received_can_packet(packet, _bus);
+
+  auto stop = std::chrono::steady_clock::now();
+  stats._allocations += _allocations.load(std::memory_order_relaxed) - allocs;
+
+  uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+  stats._latency.push_back(ns);
+  stats._total_ns += ns;
+  stats._packets++;
+}
+
+/**
+ * \fn  timed_receive_burst
+ *
+ *  Every packet of the burst is accounted with the average burst latency
+ *
+ * @param  can : CanInterface*
+ * @param  packets : const std::vector<CanPacket>&
+ * @param  stats : Stats&
+ */
+static void timed_receive_burst(CanInterface* can, const std::vector<CanPacket>& packets, Stats& stats)
+{
+  uint64_t allocs = _allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+
+  can->received_can_packets(packets.data(), packets.size(), _bus);
+
+  auto stop = std::chrono::steady_clock::now();
+  stats._allocations += _allocations.load(std::memory_order_relaxed) - allocs;
+
+  uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+  for (size_t index = 0; index < packets.size(); index++)
+    stats._latency.push_back(ns / packets.size());
+
+  stats._total_ns += ns;
+  stats._packets += packets.size();
+}
+
+/**
+ * \fn  remote_name
+ *
+ * @param  index : size_t
+ * @return  uint64_t
+ */
+static uint64_t remote_name(size_t index)
+{
+  return 0x8000000000100000llu + index;
+}
+
+/**
+ * \fn  address_claim
+ *
+ * @param  name : uint64_t
+ * @param  sa :  uint8_t
+ * @return  CanPacket
+ */
+static CanPacket address_claim(uint64_t name, uint8_t sa)
+{
+  CanName cname(name);
+  return CanPacket(cname.data(), 8, PGN_AddressClaimed, BROADCAST_CAN_ADDRESS, sa);
+}
+
+/**
+ * \fn  tp_sequence
+ *
+ * @param  control : uint8_t
+ * @param  sa : uint8_t
+ * @param  da : uint8_t
+ * @param  packets : std::vector<CanPacket>&
+ */
+static void tp_sequence(uint8_t control, uint8_t sa, uint8_t da, std::vector<CanPacket>& packets)
+{
+  uint16_t size = BENCH_TP_MESSAGE_SIZE;
+  uint8_t  num_packets = static_cast<uint8_t>((size - 1) / 7 + 1);
+  uint32_t pgn = PGN_ProprietaryB_start;
+
+  packets.push_back(CanPacket({ control,
+                      static_cast<uint8_t>(size & 0xFF), static_cast<uint8_t>(size >> 8),
+                      num_packets, 0xFF,
+                      static_cast<uint8_t>(pgn & 0xFF), static_cast<uint8_t>((pgn >> 8) & 0xFF), static_cast<uint8_t>((pgn >> 16) & 0xFF) },
+                      PGN_TP_CM, da, sa, 7));
+
+  for (uint8_t seq = 1; seq <= num_packets; seq++)
+  {
+    uint8_t data[8];
+    memset(data, seq, sizeof(data));
+    data[0] = seq;
+    packets.push_back(CanPacket(data, 8, PGN_TP_DT, da, sa, 7));
+  }
+}
+
+/**
+ * \fn  setup
+ *
+ * @param  can : CanInterface*
+ * @param  cback : StubCallback&
+ * @return  bool
+ */
+static bool setup(CanInterface* can, StubCallback& cback)
+{
+  if (!can->register_can_bus(BENCH_BUS_NAME))
+    return false;
+
+  _bus = can->get_bus_handle(BENCH_BUS_NAME);
+
+  cback.confirm_all(can);
+  cback.advance(CAN_ADDRESS_CLAIMED_WAITING_TIME + 50);
+  can->update();
+
+  LocalECUPtr local = can->create_local_ecu(CanName(0x0000000000000001llu));
+  local->activate(BENCH_LOCAL_ADDRESS, { BENCH_BUS_NAME });
+  cback.confirm_all(can);
+
+  for (size_t index = 0; index < BENCH_REMOTE_COUNT; index++)
+    can->received_can_packet(address_claim(remote_name(index), static_cast<uint8_t>(BENCH_REMOTE_FIRST + index)), _bus);
+
+  cback.advance(CAN_ADDRESS_CLAIMED_WAITING_TIME + 50);
+  can->update();
+  can->update();
+  cback.confirm_all(can);
+  return true;
+}
+
+/**
+ * \fn  run_mix
+ *
+ * @param  can : CanInterface*
+ * @param  cback : StubCallback&
+ * @param  mix : const char*
+ * @param  num_packets : size_t
+ * @param  stats : Stats&
+ */
+static void run_mix(CanInterface* can, StubCallback& cback, const char* mix, size_t num_packets, Stats& stats)
+{
+  uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  std::vector<CanPacket> sequence;
+  size_t step = 0;
+
+  bool mixed = (strcmp(mix, "mixed") == 0);
+  while (stats._packets < num_packets)
+  {
+    const char* current = mix;
+    if (mixed)
+    {
+      static const char* mixed_order[] = { "broadcast", "broadcast", "broadcast", "destination", "destination", "tp_bam", "tp_rts", "claim" };
+      current = mixed_order[step % (sizeof(mixed_order) / sizeof(mixed_order[0]))];
+    }
+
+    uint8_t sa = static_cast<uint8_t>(BENCH_REMOTE_FIRST + (step % BENCH_REMOTE_COUNT));
+    if (strcmp(current, "broadcast") == 0)
+    {
+      timed_receive(can, CanPacket(data, 8, 0xFEF1, BROADCAST_CAN_ADDRESS, sa), stats);
+    }
+    else if (strcmp(current, "destination") == 0)
+    {
+      timed_receive(can, CanPacket(data, 8, PGN_ProprietaryA, BENCH_LOCAL_ADDRESS, sa), stats);
+    }
+    else if ((strcmp(current, "tp_bam") == 0) || (strcmp(current, "tp_rts") == 0))
+    {
+      bool bam = (strcmp(current, "tp_bam") == 0);
+      sequence.clear();
+      tp_sequence(bam ? BAM : RTS, sa, bam ? BROADCAST_CAN_ADDRESS : BENCH_LOCAL_ADDRESS, sequence);
+
+      for (auto& packet : sequence)
+        timed_receive(can, packet, stats);
+
+      // Let the transport protocol retire completed sessions
+      cback.confirm_all(can);
+      can->update();
+    }
+    else if (strcmp(current, "burst") == 0)
+    {
+      sequence.clear();
+      for (size_t index = 0; index < BENCH_BURST_SIZE; index++)
+      {
+        uint8_t burst_sa = static_cast<uint8_t>(BENCH_REMOTE_FIRST + ((step + index) % BENCH_REMOTE_COUNT));
+        sequence.push_back(CanPacket(data, 8, PGN_ProprietaryA, BENCH_LOCAL_ADDRESS, burst_sa));
+      }
+      timed_receive_burst(can, sequence, stats);
+    }
+    else if (strcmp(current, "claim") == 0)
+    {
+      size_t index = step % BENCH_CLAIM_COUNT;
+      uint8_t address = static_cast<uint8_t>(BENCH_CLAIM_FIRST + ((step / BENCH_CLAIM_COUNT + index) % BENCH_CLAIM_COUNT));
+      timed_receive(can, address_claim(remote_name(BENCH_REMOTE_COUNT + index), address), stats);
+    }
+    else
+    {
+      fprintf(stderr, "unknown traffic mix '%s'\n", current);
+      return;
+    }
+
+    cback.confirm_all(can);
+    step++;
+  }
+}
+
+/**
+ * \fn  percentile
+ *
+ * @param  sorted : const std::vector<uint64_t>&
+ * @param  pct : double
+ * @return  uint64_t
+ */
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double pct)
+{
+  if (sorted.empty())
+    return 0;
+
+  size_t index = static_cast<size_t>(pct * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+/**
+ * \fn  report
+ *
+ * @param  mix : const char*
+ * @param  stats : Stats&
+ * @param  delivered : uint64_t
+ */
+static void report(const char* mix, Stats& stats, uint64_t delivered)
+{
+  std::sort(stats._latency.begin(), stats._latency.end());
+
+  double seconds = static_cast<double>(stats._total_ns) / 1e9;
+  double pps = (seconds > 0.0) ? static_cast<double>(stats._packets) / seconds : 0.0;
+  double allocs = (stats._packets != 0) ? static_cast<double>(stats._allocations) / static_cast<double>(stats._packets) : 0.0;
+
+  printf("%-12s %10llu %10llu %14.0f %9llu %9llu %9llu %12.3f\n", mix,
+            static_cast<unsigned long long>(stats._packets),
+            static_cast<unsigned long long>(delivered), pps,
+            static_cast<unsigned long long>(percentile(stats._latency, 0.50)),
+            static_cast<unsigned long long>(percentile(stats._latency, 0.99)),
+            static_cast<unsigned long long>(percentile(stats._latency, 0.999)),
+            allocs);
+}
+
+/**
+ * \fn  main
+ *
+ */
+int main(int argc, char* argv[])
+{
+  size_t num_packets = (argc > 1) ? static_cast<size_t>(strtoull(argv[1], nullptr, 0)) : 200000;
+  const char* mixes[] = { "broadcast", "destination", "burst", "tp_bam", "tp_rts", "claim", "mixed" };
+
+  printf("%-12s %10s %10s %14s %9s %9s %9s %12s\n", "mix", "packets", "delivered", "packets/s", "p50 ns", "p99 ns", "p999 ns", "allocs/pkt");
+
+  for (auto mix : mixes)
+  {
+    if ((argc > 2) && (strcmp(argv[2], mix) != 0))
+      continue;
+
+    if (!can_library_init())
+      return 1;
+
+    StubCallback cback;
+    CanInterface* can = create_can_interface(&cback);
+    if (!setup(can, cback))
+    {
+      fprintf(stderr, "bus setup failed\n");
+      return 1;
+    }
+
+    Stats stats;
+    stats._latency.reserve(num_packets + 64);
+    uint64_t received = cback._received;
+    run_mix(can, cback, mix, num_packets, stats);
+    report(mix, stats, cback._received - received);
+
+    delete_can_interface(can);
+    can_library_release();
+  }
+
+  return 0;
+}
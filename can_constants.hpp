@@ -22,6 +22,9 @@ namespace can {
  */
 enum PGNs
 {
+  PGN_ETP_DT              = 0xC700, // 50944  - Extended Transport Protocol Data Transfer
+  PGN_ETP_CM              = 0xC800, // 51200  - Extended Transport Protocol Connection Management
+
   PGN_AckNack             = 0xE800, // 59392
   PGN_Request             = 0xEA00, // 59904
 
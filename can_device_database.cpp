@@ -25,7 +25,10 @@ namespace can {
 CanDeviceDatabase::CanDeviceDatabase(CanProcessor* processor)
 : _processor(processor)
 , _mutex(processor)
+, _generation(0)
 {
+  for (auto& snapshot : _snapshots)
+    snapshot.store(nullptr, std::memory_order_relaxed);
 }
 
 /**
@@ -36,31 +39,35 @@ CanDeviceDatabase::~CanDeviceDatabase()
 {
   _remote_devices.clear();
   _prerecorded_local_devices.clear();
+
+  for (auto& snapshot : _snapshots)
+    delete snapshot.exchange(nullptr);
 }
 
 /**
  * \fn  CanDeviceDatabase::create_bus
  *
  * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
-void CanDeviceDatabase::create_bus(const ConstantString& bus_name)
+void CanDeviceDatabase::create_bus(const ConstantString& bus_name,CanBusHandle bus)
 {
   bool register_pgn = false;
   {
     std::lock_guard<Mutex> l(_mutex);
     register_pgn = _device_map.empty();
-    if (_device_map.find_if( [bus_name](const DeviceMap::value_type& value)->bool
-        { return value.first == bus_name; }) != _device_map.end())
-    {
+    if (_device_map.push_at(bus, DeviceMap::value_type(bus_name, BusMap())) == _device_map.end())
       return;
-    }
-  
-    _device_map.push(DeviceMap::value_type(bus_name, BusMap()));
+
+    if ((bus < _snapshots.size()) && (_snapshots[bus].load(std::memory_order_relaxed) == nullptr))
+      _snapshots[bus].store(new BusSnapshot(), std::memory_order_release);
+
+    _generation++;
   }
 
   if (register_pgn)
   {
-    _processor->register_pgn_receiver(PGN_AddressClaimed, [this](const CanPacket& packet,const ConstantString& bus)
+    _processor->register_pgn_receiver(PGN_AddressClaimed, [this](const CanPacket& packet,CanBusHandle bus)
     {
       pgn_received(packet, bus);
     });
@@ -68,22 +75,54 @@ void CanDeviceDatabase::create_bus(const ConstantString& bus_name)
 }
 
 /**
- * \fn  CanDeviceDatabase::get_ecu_by_address
+ * \fn  CanDeviceDatabase::find_bus
  *
- * @param  sa : uint8_t 
  * @param   bus_name : const ConstantString&
- * @return  CanECUPtr
+ * @return  CanBusHandle
  */
-CanECUPtr CanDeviceDatabase::get_ecu_by_address(uint8_t sa,const ConstantString& bus_name) const
+CanBusHandle CanDeviceDatabase::find_bus(const ConstantString& bus_name) const
 {
   std::lock_guard<Mutex> l(_mutex);
   auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
       { return value.first == bus_name; });
 
   if (bus_iter == _device_map.end())
+    return INVALID_CAN_BUS_HANDLE;
+
+  return static_cast<CanBusHandle>(_device_map.index(bus_iter));
+}
+
+/**
+ * \fn  CanDeviceDatabase::get_ecu_by_address
+ *
+ * @param  sa : uint8_t 
+ * @param   bus_name : const ConstantString&
+ * @return  CanECUPtr
+ */
+CanECUPtr CanDeviceDatabase::get_ecu_by_address(uint8_t sa,const ConstantString& bus_name) const
+{
+  return get_ecu_by_address(sa, find_bus(bus_name));
+}
+
+/**
+ * \fn  CanDeviceDatabase::get_ecu_by_address
+ *
+ *  Lock free, reads the published snapshot of the bus
+ *
+ * @param  sa : uint8_t 
+ * @param   bus : CanBusHandle
+ * @return  CanECUPtr
+ */
+CanECUPtr CanDeviceDatabase::get_ecu_by_address(uint8_t sa,CanBusHandle bus) const
+{
+  if (bus >= _snapshots.size())
+    return CanECUPtr();
+
+  const BusSnapshot* snapshot = _snapshots[bus].load(std::memory_order_acquire);
+  if (snapshot == nullptr)
     return CanECUPtr();
 
-  return bus_iter->second[sa];
+  return snapshot->get(sa);
 }
 
 /**
@@ -95,36 +134,29 @@ CanECUPtr CanDeviceDatabase::get_ecu_by_address(uint8_t sa,const ConstantString&
  */
 CanECUPtr CanDeviceDatabase::get_ecu_by_name(const CanName& name,const ConstantString& bus_name) const
 {
-  std::lock_guard<Mutex> l(_mutex);
   if (bus_name.empty())
-  {
-    for (auto bus_iter : _device_map)
-    {
-      auto device_iter = std::find_if(bus_iter.second.begin(),bus_iter.second.end(),[name](const CanECUPtr& ecu)->bool
-          {
-            return (ecu && (ecu->name().data64() == name.data64()));
-          });
-      
-      if (device_iter != bus_iter.second.end())
-        return (*device_iter);
-    }
-  }
-  else
-  {
-    auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-        { return value.first == bus_name; });
+    return get_ecu_by_name(name);
 
-    if (bus_iter != _device_map.end())
-    {
-      auto device_iter = std::find_if(bus_iter->second.begin(),bus_iter->second.end(),[name](const CanECUPtr& ecu)->bool
-          {
-            return (ecu && (ecu->name().data64() == name.data64()));
-          });
-      
-      if (device_iter != bus_iter->second.end())
-        return (*device_iter);
-    }
-  }
+  CanBusHandle bus = find_bus(bus_name);
+  if (bus == INVALID_CAN_BUS_HANDLE)
+    return CanECUPtr();
+
+  return get_ecu_by_name(name, bus);
+}
+
+/**
+ * \fn  CanDeviceDatabase::get_ecu_by_name
+ *
+ * @param   name : const CanName&
+ * @param   bus : CanBusHandle, INVALID_CAN_BUS_HANDLE looks through all buses
+ * @return  CanECUPtr
+ */
+CanECUPtr CanDeviceDatabase::get_ecu_by_name(const CanName& name,CanBusHandle bus /*= INVALID_CAN_BUS_HANDLE*/) const
+{
+  std::lock_guard<Mutex> l(_mutex);
+  uint8_t address = find_address(name, bus);
+  if (address != NULL_CAN_ADDRESS)
+    return _device_map.at(bus)->second[address];
   
   auto iter = _prerecorded_local_devices.find_if([name](const LocalECUPtr& local)->bool
       { return name.data64() == local->name().data64(); });
@@ -144,35 +176,55 @@ CanECUPtr CanDeviceDatabase::get_ecu_by_name(const CanName& name,const ConstantS
  */
 uint8_t CanDeviceDatabase::get_ecu_address(const CanName& ecu_name,const ConstantString& bus_name) const
 {
-  std::lock_guard<Mutex> l(_mutex);
   if (bus_name.empty())
+    return get_ecu_address(ecu_name);
+
+  CanBusHandle bus = find_bus(bus_name);
+  if (bus == INVALID_CAN_BUS_HANDLE)
+    return NULL_CAN_ADDRESS;
+
+  return get_ecu_address(ecu_name, bus);
+}
+
+/**
+ * \fn  CanDeviceDatabase::get_ecu_address
+ *
+ * @param   ecu_name : const CanName&
+ * @param   bus : CanBusHandle, INVALID_CAN_BUS_HANDLE looks through all buses
+ * @return  uint8_t
+ */
+uint8_t CanDeviceDatabase::get_ecu_address(const CanName& ecu_name,CanBusHandle bus /*= INVALID_CAN_BUS_HANDLE*/) const
+{
+  std::lock_guard<Mutex> l(_mutex);
+  return find_address(ecu_name, bus);
+}
+
+/**
+ * \fn  CanDeviceDatabase::find_address
+ *
+ *  NAME index lookup, the caller holds the lock
+ *
+ * @param   ecu_name : const CanName&
+ * @param   bus : CanBusHandle&, INVALID_CAN_BUS_HANDLE looks through all
+ *                buses and receives the bus the ECU was found on
+ * @return  uint8_t
+ */
+uint8_t CanDeviceDatabase::find_address(const CanName& ecu_name,CanBusHandle& bus) const
+{
+  if (bus != INVALID_CAN_BUS_HANDLE)
+    return _name_index.get(ecu_name.data64(), bus);
+
+  for (auto bus_iter = _device_map.begin(); bus_iter != _device_map.end(); ++bus_iter)
   {
-    for (auto bus_iter : _device_map)
+    CanBusHandle handle = static_cast<CanBusHandle>(_device_map.index(bus_iter));
+    uint8_t address = _name_index.get(ecu_name.data64(), handle);
+    if (address != NULL_CAN_ADDRESS)
     {
-      auto& array = bus_iter.second;
-      for (size_t index = 0; index < array.size(); index++)
-      {
-        if (array[index] && (array[index]->name().data64() == ecu_name.data64()))
-          return static_cast<uint8_t>(index);
-      }
+      bus = handle;
+      return address;
     }
   }
-  else
-  {
-    auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-        { return value.first == bus_name; });
 
-    if (bus_iter != _device_map.end())
-    {
-      auto& array = bus_iter->second;
-      for (size_t index = 0; index < array.size(); index++)
-      {
-        if (array[index] && (array[index]->name().data64() == ecu_name.data64()))
-          return static_cast<uint8_t>(index);
-      }
-    }
-  }
-  
   return NULL_CAN_ADDRESS;
 }
 
@@ -180,9 +232,9 @@ uint8_t CanDeviceDatabase::get_ecu_address(const CanName& ecu_name,const Constan
  * \fn  CanDeviceDatabase::pgn_received
  *
  * @param   packet : const CanPacket&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
-void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantString& bus_name)
+void CanDeviceDatabase::pgn_received(const CanPacket& packet,CanBusHandle bus)
 {
   if (packet.pgn() != PGN_AddressClaimed)
     return;
@@ -192,7 +244,7 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
   RemoteECUPtr remote;
 
   CanName name(packet.data());
-  uint8_t address = get_ecu_address(name, bus_name);
+  uint8_t address = get_ecu_address(name, bus);
   if (address == packet.sa())
   { 
     // This ecu is already egistered under 
@@ -202,9 +254,7 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
 
   {
     std::lock_guard<Mutex> l(_mutex);
-    auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-        { return value.first == bus_name; });
-
+    auto bus_iter = _device_map.at(bus);
     if (bus_iter == _device_map.end())
       return;
 
@@ -235,7 +285,7 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
         // TODO: notify about ECU error !!!
       }
 
-      bus_map[address] = CanECUPtr();
+      set_slot(bus_map, bus, address, CanECUPtr());
     }
 
     // Check if this is a new Remote device sending address claim
@@ -254,7 +304,7 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
       // or relocate old one
       // Note: in case if there is some remote device exist under 
       // requested address the thser function will remove it from the map
-      bus_map[packet.sa()] = by_name;
+      set_slot(bus_map, bus, packet.sa(), by_name);
     }
     else if (is_local_ecu(by_addr))
     {
@@ -272,7 +322,7 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
       {
         // Ok here we are trying to change our address, but first
         // we will need to put remote device back to the map
-        bus_map[packet.sa()] =  by_name;
+        set_slot(bus_map, bus, packet.sa(), by_name);
 
         if (!local->name().is_self_configurable())
         {
@@ -284,20 +334,24 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
         {
           sa = find_free_address(bus_map);
           if (sa != NULL_CAN_ADDRESS)
-            bus_map[sa] = local;
+            set_slot(bus_map, bus, sa, local);
 
         }
       }
     }
+
+    // Address caches are tagged with the generation read before
+    // their lookup, so it moves only once every slot is in place
+    _generation++;
   } // mutex lock
 
   if (local && (sa != BROADCAST_CAN_ADDRESS))
-    local->claim_address(sa, bus_name);
+    local->claim_address(sa, bus);
 
   if (remote)
   {
     remote->init_status();
-    _processor->on_remote_ecu(remote, bus_name);
+    _processor->on_remote_ecu(remote, bus);
   }
 }
 
@@ -305,19 +359,19 @@ void CanDeviceDatabase::pgn_received(const CanPacket& packet,const ConstantStrin
  * \fn  CanDeviceDatabase::add_local_ecu
  *
  * @param  ecu : LocalECUPtr 
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param  address : uint8_t 
  * @return  bool
  */
-bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus_name,uint8_t address)
+bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, CanBusHandle bus,uint8_t address)
 {
-  CanBusStatus stat = _processor->get_bus_status(bus_name);
+  CanBusStatus stat = _processor->get_bus_status(bus);
   if (stat == eBusInactive)
     return false;
   
   if (stat != eBusActive)
   {
-    _processor->register_bus_callback(bus_name,[this,ecu,address](const ConstantString& bus_name, CanBusStatus status)->bool
+    _processor->register_bus_callback(bus,[this,ecu,address](CanBusHandle bus, CanBusStatus status)->bool
     {
       if (status == eBusInactive)
         return true;
@@ -325,7 +379,7 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
       if (status != eBusActive)
         return false; // Waiting state
 
-      add_local_ecu(ecu, bus_name, address);
+      add_local_ecu(ecu, bus, address);
       return true;
     });
 
@@ -348,9 +402,7 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
     if (iter != _prerecorded_local_devices.end())
       _prerecorded_local_devices.erase(iter);
 
-    auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-        { return value.first == bus_name; });
-
+    auto bus_iter = _device_map.at(bus);
     if (bus_iter == _device_map.end())
       return false;
 
@@ -360,7 +412,7 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
       if (address == NULL_CAN_ADDRESS)
         return false;
 
-      bus_iter->second[address] = ecu;
+      set_slot(bus_iter->second, bus, address, ecu);
       claim = true;
     }
     else
@@ -387,7 +439,7 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
           {
             // Our ecu has higher priority
             // So we try to push the other one out
-            bus_iter->second[address] = ecu;
+            set_slot(bus_iter->second, bus, address, ecu);
             claim = true;
           }
           else
@@ -400,14 +452,17 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
       }
       else
       {
-        bus_iter->second[address] = ecu;
+        set_slot(bus_iter->second, bus, address, ecu);
         claim = true;
       }
     }
+
+    if (claim)
+      _generation++;
   }// mutex unlock
 
   if (claim)
-    ecu->claim_address(address, bus_name);
+    ecu->claim_address(address, bus);
 
   return true;
 }
@@ -416,50 +471,38 @@ bool CanDeviceDatabase::add_local_ecu(LocalECUPtr ecu, const ConstantString& bus
  * \fn  CanDeviceDatabase::remove_local_ecu
  *
  * @param   ecu_name : const CanName&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  * @return  bool
  */
-bool CanDeviceDatabase::remove_local_ecu(const CanName& ecu_name,const ConstantString& bus_name)
+bool CanDeviceDatabase::remove_local_ecu(const CanName& ecu_name,CanBusHandle bus)
 {
   std::lock_guard<Mutex> l(_mutex);
-  auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-      { return value.first == bus_name; });
-
+  auto bus_iter = _device_map.at(bus);
   if (bus_iter == _device_map.end())
     return false;
 
-  BusMap& bus_map = bus_iter->second;
-  for (size_t index = 0; index < bus_map.size(); index++)
-  {
-    LocalECUPtr local(bus_map[index]);
-    if (!local)
-      continue;
-    
-    if (local->name().data64() == ecu_name.data64())
-    {
-      bus_map[index].reset();
-      return true;
-    }
-  }
+  uint8_t address = _name_index.get(ecu_name.data64(), bus);
+  if ((address == NULL_CAN_ADDRESS) || !is_local_ecu(bus_iter->second[address]))
+    return false;
 
-  return false;
+  set_slot(bus_iter->second, bus, address, CanECUPtr());
+  _generation++;
+  return true;
 }
 
 /**
  * \fn  CanDeviceDatabase::add_remote_abstract_ecu
  *
  * @param  ecu : RemoteECUPtr 
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param  address : uint8_t 
  * @return  bool
  */
 bool CanDeviceDatabase::add_remote_abstract_ecu(RemoteECUPtr ecu, 
-                const ConstantString& bus_name,uint8_t address)
+                CanBusHandle bus,uint8_t address)
 {
   std::lock_guard<Mutex> l(_mutex);
-  auto bus_iter = _device_map.find_if([bus_name](const DeviceMap::value_type& value)->bool
-      { return value.first == bus_name; });
-
+  auto bus_iter = _device_map.at(bus);
   if (bus_iter == _device_map.end())
     return false;
 
@@ -467,7 +510,8 @@ bool CanDeviceDatabase::add_remote_abstract_ecu(RemoteECUPtr ecu,
   if (bus_map[address])
     return false;
 
-  bus_map[address] = ecu;
+  set_slot(bus_map, bus, address, ecu);
+  _generation++;
   return true;
 }
 
@@ -512,6 +556,26 @@ void CanDeviceDatabase::get_local_ecus(fixed_list<LocalECUPtr>& list,
   }
 }
 
+/**
+ * \fn  CanDeviceDatabase::get_local_ecus
+ *
+ * @param   list : fixed_list<LocalECUPtr>&
+ * @param   bus : CanBusHandle
+ */
+void CanDeviceDatabase::get_local_ecus(fixed_list<LocalECUPtr>& list, CanBusHandle bus)
+{
+  std::lock_guard<Mutex> l(_mutex);
+  auto bus_iter = _device_map.at(bus);
+  if (bus_iter == _device_map.end())
+    return;
+
+  for (auto device : bus_iter->second)
+  {
+    if (is_local_ecu(device))
+      list.push(LocalECUPtr(device));
+  }
+}
+
 /**
  * \fn  CanDeviceDatabase::get_remote_ecus
  *
@@ -581,6 +645,145 @@ uint8_t CanDeviceDatabase::find_free_address(BusMap& bus_map)
   return sa;
 }
 
+/**
+ * \fn  CanDeviceDatabase::set_slot
+ *
+ *  Every change of a BusMap slot goes through here to keep the NAME
+ *  index in step, the caller holds the lock
+ *
+ * @param  bus_map : BusMap&
+ * @param  bus : CanBusHandle
+ * @param  address : uint8_t
+ * @param  ecu : const CanECUPtr&
+ */
+void CanDeviceDatabase::set_slot(BusMap& bus_map,CanBusHandle bus,uint8_t address,const CanECUPtr& ecu)
+{
+  if (bus_map[address])
+    _name_index.erase(bus_map[address]->name().data64(), bus, address);
+
+  bus_map[address] = ecu;
+  if (ecu && (address < NULL_CAN_ADDRESS))
+    _name_index.set(ecu->name().data64(), bus, address);
+
+  BusSnapshot* snapshot = (bus < _snapshots.size()) ? _snapshots[bus].load(std::memory_order_relaxed) : nullptr;
+  if (snapshot != nullptr)
+    snapshot->set(address, ecu);
+}
+
+/**
+ * \fn  constructor CanDeviceDatabase::BusSnapshot::BusSnapshot
+ *
+ */
+CanDeviceDatabase::BusSnapshot::BusSnapshot()
+: _current(0)
+{
+  for (auto& readers : _readers)
+    readers.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * \fn  CanDeviceDatabase::BusSnapshot::get
+ *
+ *  A reader that pinned a copy the writer has just left retries
+ *  on the current one
+ *
+ * @param  address : uint8_t
+ * @return  CanECUPtr
+ */
+CanECUPtr CanDeviceDatabase::BusSnapshot::get(uint8_t address) const
+{
+  for (;;)
+  {
+    uint32_t index = _current.load();
+    _readers[index].fetch_add(1);
+    if (_current.load() == index)
+    {
+      CanECUPtr ecu = _maps[index][address];
+      _readers[index].fetch_sub(1, std::memory_order_release);
+      return ecu;
+    }
+    _readers[index].fetch_sub(1, std::memory_order_release);
+  }
+}
+
+/**
+ * \fn  CanDeviceDatabase::BusSnapshot::set
+ *
+ *  The caller holds the database lock
+ *
+ * @param  address : uint8_t
+ * @param  ecu : const CanECUPtr&
+ */
+void CanDeviceDatabase::BusSnapshot::set(uint8_t address,const CanECUPtr& ecu)
+{
+  uint32_t current = _current.load(std::memory_order_relaxed);
+  uint32_t standby = current ^ 1;
+
+  drain(standby);
+  _maps[standby][address] = ecu;
+  _current.store(standby);
+
+  drain(current);
+  _maps[current][address] = ecu;
+}
+
+/**
+ * \fn  CanDeviceDatabase::BusSnapshot::drain
+ *
+ *  Readers hold a copy only for the time of one slot read
+ *
+ * @param  index : uint32_t
+ */
+void CanDeviceDatabase::BusSnapshot::drain(uint32_t index) const
+{
+  while (_readers[index].load() != 0)
+    cpu_relax();
+}
+
+/**
+ * \fn  CanDeviceDatabase::NameIndex::set
+ *
+ * @param  name : uint64_t
+ * @param  bus : CanBusHandle
+ * @param  address : uint8_t
+ */
+void CanDeviceDatabase::NameIndex::set(uint64_t name,CanBusHandle bus,uint8_t address)
+{
+  uint8_t* entry = _table.insert(Key(name, bus));
+  if (entry != nullptr)
+    *entry = address;
+}
+
+/**
+ * \fn  CanDeviceDatabase::NameIndex::erase
+ *
+ *  Drops the entry only if it still points to address, the ECU may
+ *  have been registered under another address meanwhile
+ *
+ * @param  name : uint64_t
+ * @param  bus : CanBusHandle
+ * @param  address : uint8_t
+ */
+void CanDeviceDatabase::NameIndex::erase(uint64_t name,CanBusHandle bus,uint8_t address)
+{
+  const uint8_t* entry = _table.find(Key(name, bus));
+  if ((entry != nullptr) && (*entry == address))
+    _table.erase(Key(name, bus));
+}
+
+/**
+ * \fn  CanDeviceDatabase::NameIndex::get
+ *
+ * @param  name : uint64_t
+ * @param  bus : CanBusHandle
+ * @return  uint8_t, NULL_CAN_ADDRESS if the NAME is not on the bus
+ */
+uint8_t CanDeviceDatabase::NameIndex::get(uint64_t name,CanBusHandle bus) const
+{
+  const uint8_t* entry = _table.find(Key(name, bus));
+  return (entry == nullptr) ? NULL_CAN_ADDRESS : *entry;
+}
+
 } // can
 } // brt
 
@@ -22,6 +22,8 @@
 namespace brt {
 namespace can {
 
+// NAME index slots, enough for every address of every bus
+#define NAME_INDEX_SLOTS_BITS               (13)
 
 class CanProcessor;
 /**
@@ -31,31 +33,42 @@ class CanProcessor;
 class CanDeviceDatabase  
 {
   typedef std::array<CanECUPtr, 256>                  BusMap;
-  typedef fixed_list<std::pair<CanString,BusMap>,32>  DeviceMap;
+  // Indexed by CanBusHandle
+  typedef fixed_list<std::pair<CanString,BusMap>,MAX_CAN_BUSES>  DeviceMap;
 
 public:
   CanDeviceDatabase(CanProcessor*);
   virtual ~CanDeviceDatabase();
 
-          void                    create_bus(const ConstantString& bus_name);
+          void                    create_bus(const ConstantString& bus_name,CanBusHandle bus);
 
           CanECUPtr               get_ecu_by_address(uint8_t sa,const ConstantString& bus_name) const;
+          CanECUPtr               get_ecu_by_address(uint8_t sa,CanBusHandle bus) const;
           CanECUPtr               get_ecu_by_name(const CanName& ecu_name,const ConstantString& bus_name) const;
+          CanECUPtr               get_ecu_by_name(const CanName& ecu_name,CanBusHandle bus = INVALID_CAN_BUS_HANDLE) const;
           uint8_t                 get_ecu_address(const CanName& ecu_name,const ConstantString& bus_name) const;
+          uint8_t                 get_ecu_address(const CanName& ecu_name,CanBusHandle bus = INVALID_CAN_BUS_HANDLE) const;
       
-          bool                    add_local_ecu(LocalECUPtr ecu, const ConstantString& bus_name,uint8_t address);
-          bool                    remove_local_ecu(const CanName& ecu_name,const ConstantString& bus_name);
+          bool                    add_local_ecu(LocalECUPtr ecu, CanBusHandle bus,uint8_t address);
+          bool                    remove_local_ecu(const CanName& ecu_name,CanBusHandle bus);
           
-          bool                    add_remote_abstract_ecu(RemoteECUPtr ecu, const ConstantString& bus_name,uint8_t address);
+          bool                    add_remote_abstract_ecu(RemoteECUPtr ecu, CanBusHandle bus,uint8_t address);
 
           void                    get_local_ecus(fixed_list<LocalECUPtr>& list, 
                                                 const std::initializer_list<ConstantString>& buses = std::initializer_list<ConstantString>());
+          void                    get_local_ecus(fixed_list<LocalECUPtr>& list, CanBusHandle bus);
           void                    get_remote_ecus(fixed_list<RemoteECUPtr>& list, 
                                                 const std::initializer_list<ConstantString>& buses = std::initializer_list<ConstantString>());
 
+          // Changes whenever any address slot changes
+          uint32_t                generation() const { return _generation.load(std::memory_order_acquire); }
+
 private:
-          void                    pgn_received(const CanPacket& packet,const ConstantString& bus_name);
+          void                    pgn_received(const CanPacket& packet,CanBusHandle bus);
           uint8_t                 find_free_address(BusMap& bus_map);
+          void                    set_slot(BusMap& bus_map,CanBusHandle bus,uint8_t address,const CanECUPtr& ecu);
+          uint8_t                 find_address(const CanName& ecu_name,CanBusHandle& bus) const;
+          CanBusHandle            find_bus(const ConstantString& bus_name) const;
           
           bool                    is_local_ecu(CanECUPtr ecu) 
           { return LocalECUPtr(ecu).get() != nullptr; }
@@ -64,10 +77,81 @@ private:
           { return RemoteECUPtr(ecu).get() != nullptr; }
 
 private:
+  /**
+   * \class NameIndex
+   *
+   *  Open addressing table from (NAME, bus) to the address the
+   *  ECU holds on that bus. Kept in step with the BusMaps by set_slot.
+   */
+  class NameIndex
+  {
+  public:
+            void                  set(uint64_t name,CanBusHandle bus,uint8_t address);
+            void                  erase(uint64_t name,CanBusHandle bus,uint8_t address);
+            uint8_t               get(uint64_t name,CanBusHandle bus) const;
+
+  private:
+    /**
+     * \struct Key
+     *
+     */
+    struct Key
+    {
+      Key() : _name(0ULL), _bus(INVALID_CAN_BUS_HANDLE) {}
+      Key(uint64_t name,CanBusHandle bus) : _name(name), _bus(bus) {}
+
+      bool                        operator==(const Key& key) const
+      { return (_name == key._name) && (_bus == key._bus); }
+
+      uint64_t                    _name;
+      CanBusHandle                _bus;     // INVALID_CAN_BUS_HANDLE is a free slot
+    };
+
+    /**
+     * \struct Hash
+     *
+     */
+    struct Hash
+    {
+      uint64_t                    operator()(const Key& key) const
+      { return key._name ^ (key._bus * 0x9E3779B97F4A7C15ULL); }
+    };
+
+    open_table<Key,uint8_t,NAME_INDEX_SLOTS_BITS,Hash> _table;
+  };
+
+  /**
+   * \class BusSnapshot
+   *
+   *  Two copies of a BusMap for lock free readers (left-right scheme).
+   *  Readers pin the copy _current points to. The writer updates the
+   *  other copy, flips _current and then updates the copy it left
+   *  once its readers are gone. Writers hold the database lock.
+   */
+  class BusSnapshot
+  {
+  public:
+    BusSnapshot();
+
+            CanECUPtr             get(uint8_t address) const;
+            void                  set(uint8_t address,const CanECUPtr& ecu);
+
+  private:
+            void                  drain(uint32_t index) const;
+
+    std::array<BusMap,2>          _maps;
+    mutable std::array<std::atomic_uint32_t,2> _readers;
+    std::atomic_uint32_t          _current;
+  };
+
   CanProcessor*                   _processor;
   mutable Mutex                   _mutex;
   
   DeviceMap                       _device_map;
+  // Indexed by CanBusHandle, read without the lock
+  std::array<std::atomic<BusSnapshot*>,MAX_CAN_BUSES> _snapshots;
+  NameIndex                       _name_index;
+  std::atomic_uint32_t            _generation;
   fixed_list<CanECUPtr>           _remote_devices;
   fixed_list<LocalECUPtr,32>      _prerecorded_local_devices;
 };
@@ -22,7 +22,8 @@ CanECU::CanECU(CanProcessor* processor,const CanName& name /*= CanName()*/)
 : _processor(processor)
 , _name(name)
 {
-
+  for (auto& entry : _address_cache)
+    entry.store(0, std::memory_order_relaxed);
 }
 
 /**
@@ -45,6 +46,34 @@ uint8_t CanECU::get_address(const ConstantString& bus_name) const
   return _processor->device_db().get_ecu_address(name(), bus_name);
 }
 
+/**
+ * \fn  CanECU::get_address
+ *
+ *  Served from the per bus cache while the device database
+ *  generation is unchanged
+ *
+ * @param   bus : CanBusHandle
+ * @return  uint8_t
+ */
+uint8_t CanECU::get_address(CanBusHandle bus) const
+{
+  CanDeviceDatabase& db = _processor->device_db();
+  if (bus >= _address_cache.size())
+    return db.get_ecu_address(name(), bus);
+
+  // The generation is read before the lookup, so an entry stored
+  // across an address change is already stale
+  uint32_t generation = db.generation();
+  uint64_t entry = _address_cache[bus].load(std::memory_order_acquire);
+  if ((entry & _cache_valid) && (static_cast<uint32_t>(entry >> 32) == generation))
+    return static_cast<uint8_t>(entry & 0xFF);
+
+  uint8_t address = db.get_ecu_address(name(), bus);
+  _address_cache[bus].store((static_cast<uint64_t>(generation) << 32) | _cache_valid | address,
+                            std::memory_order_release);
+  return address;
+}
+
 /**
  * \fn  CanECU::set_pgn_transcoder
  *
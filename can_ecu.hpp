@@ -12,6 +12,9 @@
 #include "can_utils.hpp"
 #include "can_transcoder.hpp"
 
+#include <array>
+#include <atomic>
+
 namespace brt {
 namespace can {
 
@@ -29,6 +32,7 @@ public:
           const CanName&          name() const { return _name; }
 
           uint8_t                 get_address(const ConstantString& bus_name) const;
+          uint8_t                 get_address(CanBusHandle bus) const;
 
 protected:
           CanProcessor*           processor() { return _processor; }
@@ -39,6 +43,11 @@ private:
   CanProcessor*                   _processor;
   CanName                         _name;
 
+  // Per bus (device database generation << 32) | _cache_valid | address,
+  // a generation change makes every entry stale
+  static  constexpr uint64_t      _cache_valid = 0x100;
+  mutable std::array<std::atomic_uint64_t,MAX_CAN_BUSES> _address_cache;
+
 private:
 
   fixed_list<CanTranscoderPtr,6>  _trans_map;
@@ -34,6 +34,7 @@ CanInterface::CanInterface(Callback* callback)
 
 
 static bool _library_initialized = false;
+static LibraryConfig _library_config;
 
 /**
  * \fn  can_library_init
@@ -46,8 +47,7 @@ bool can_library_init(const LibraryConfig& cfg /*= LibraryConfig()*/)
   if (_library_initialized)
     return false;
 
-  if ((CanMessage::_small_msg_allocator != nullptr) ||
-      (CanMessage::_big_msg_allocator != nullptr)   ||
+  if ((CanMessage::_msg_allocators_count != 0) ||
       (LocalECU::_allocator != nullptr)   ||
       (RemoteECU::_allocator != nullptr)  ||
       (TxSession::_allocator != nullptr)  ||
@@ -57,8 +57,21 @@ bool can_library_init(const LibraryConfig& cfg /*= LibraryConfig()*/)
       (CanTranscoderDiagProt::_allocator != nullptr))
     return false;
   
-  CanMessage::_small_msg_allocator    = new allocator<CanMessage,8>(cfg._small_messages_pool_size);
-  CanMessage::_big_msg_allocator      = new allocator<CanMessage,255*7>(cfg._big_messages_pool_size);
+  // Message size classes in ascending payload order
+  std::array<LibraryConfig::MessageSizeClass,MAX_MESSAGE_SIZE_CLASSES> classes = cfg._message_size_classes;
+  std::sort(classes.begin(), classes.end(), 
+      [](const LibraryConfig::MessageSizeClass& a, const LibraryConfig::MessageSizeClass& b) 
+      { return a._payload_size < b._payload_size; });
+
+  for (auto size_class : classes)
+  {
+    if (size_class._payload_size == 0)
+      continue;
+
+    CanMessage::_msg_allocators[CanMessage::_msg_allocators_count++] = 
+                new pool_allocator(sizeof(CanMessage) + size_class._payload_size, size_class._pool_size);
+  }
+
   LocalECU::_allocator                = new allocator<LocalECU>(cfg._local_ecu_pool_size);
   RemoteECU::_allocator               = new allocator<RemoteECU>(cfg._remote_ecu_pool_size);
   TxSession::_allocator               = new allocator<TxSession>(cfg._tx_tpsessions_pool_size);
@@ -67,6 +80,7 @@ bool can_library_init(const LibraryConfig& cfg /*= LibraryConfig()*/)
   CanTranscoderEcuId::_allocator      = new allocator<CanTranscoderEcuId>(cfg._transcoder_pool_size); 
   CanTranscoderDiagProt::_allocator   = new allocator<CanTranscoderDiagProt>(cfg._transcoder_pool_size); 
 
+  _library_config = cfg;
   _library_initialized = true;
   return true;
 }
@@ -81,11 +95,11 @@ bool can_library_release()
   if (!_library_initialized)
     return false;
 
-  if (CanMessage::_small_msg_allocator != nullptr)
-    delete CanMessage::_small_msg_allocator;
-
-  if (CanMessage::_big_msg_allocator != nullptr)
-    delete CanMessage::_big_msg_allocator;
+  for (size_t index = 0; index < CanMessage::_msg_allocators_count; index++)
+  {
+    delete CanMessage::_msg_allocators[index];
+    CanMessage::_msg_allocators[index] = nullptr;
+  }
     
   if (LocalECU::_allocator != nullptr)
     delete LocalECU::_allocator;
@@ -108,8 +122,7 @@ bool can_library_release()
   if (CanTranscoderDiagProt::_allocator != nullptr)
     delete CanTranscoderDiagProt::_allocator;
 
-  CanMessage::_small_msg_allocator    = nullptr;
-  CanMessage::_big_msg_allocator      = nullptr;
+  CanMessage::_msg_allocators_count   = 0;
   LocalECU::_allocator                = nullptr;
   RemoteECU::_allocator               = nullptr;
   TxSession::_allocator               = nullptr;
@@ -122,6 +135,16 @@ bool can_library_release()
   return true;
 }
 
+/**
+ * \fn  can_library_config
+ *
+ * @return  const LibraryConfig& configuration passed to can_library_init
+ */
+const LibraryConfig& can_library_config()
+{
+  return _library_config;
+}
+
 /**
  * \fn  create_can_interface
  *
@@ -37,6 +37,19 @@ public:
     virtual uint64_t                get_time_tick_nanoseconds() const = 0;
     virtual void                    message_received(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,const ConstantString& bus_name) = 0;
     virtual void                    send_can_packet(const ConstantString& bus, const CanPacket& packet) = 0;
+    /**
+     * \fn  send_can_packets
+     *
+     *  Used whenever the library has several frames ready for the same bus.
+     *  Override to hand them to a bulk TX path (sendmmsg, driver TX queue).
+     *  Neither send call holds a library bus lock, confirmations may be
+     *  delivered from inside them.
+     */
+    virtual void                    send_can_packets(const ConstantString& bus, const CanPacket* packets, size_t count)
+    {
+      for (size_t index = 0; index < count; index++)
+        send_can_packet(bus, packets[index]);
+    }
     virtual void                    on_remote_ecu(const RemoteECUPtr& remote,const ConstantString& bus_name) = 0;
 
     virtual uint32_t                create_mutex() = 0;
@@ -50,7 +63,8 @@ public:
   virtual ~CanInterface() {}
 
   virtual bool                    register_can_bus(const ConstantString& bus) = 0;
-  virtual void                    update() = 0;
+  virtual CanBusHandle            get_bus_handle(const ConstantString& bus) const = 0;
+  virtual uint64_t                update() = 0;
   virtual LocalECUPtr             create_local_ecu(const CanName& name) = 0;
   virtual RemoteECUPtr            register_abstract_remote_ecu(uint8_t address,const ConstantString& bus) = 0;
 
@@ -58,8 +72,13 @@ public:
   virtual bool                    destroy_local_ecu(const CanName& name) = 0;
 
   virtual bool                    received_can_packet(const CanPacket& packet,const ConstantString& bus) = 0;
+  virtual bool                    received_can_packet(const CanPacket& packet,CanBusHandle bus) = 0;
+  virtual size_t                  received_can_packets(const CanPacket* packets,size_t count,const ConstantString& bus) = 0;
+  virtual size_t                  received_can_packets(const CanPacket* packets,size_t count,CanBusHandle bus) = 0;
   virtual bool                    send_can_message(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,
                                                         const std::initializer_list<ConstantString>& buses = std::initializer_list<ConstantString>()) = 0;
+  virtual bool                    send_can_message(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,
+                                                        CanBusHandle bus) = 0;
 
 
   virtual void                    can_packet_confirm(uint64_t packet_id,CanMessageConfirmation) = 0;
@@ -69,6 +88,8 @@ public:
                                                 const std::initializer_list<ConstantString>& buses = std::initializer_list<ConstantString>()) = 0;
 
   virtual bool                    request_pgn(uint32_t pgn,const LocalECUPtr& local,const RemoteECUPtr& remote,const RequestCallback& callback) = 0;
+  virtual void                    register_fast_packet_pgn(uint32_t pgn) = 0;
+  virtual void                    set_rx_buffer_provider(CanBufferProvider* provider) = 0;
 
 protected:
   CanInterface(Callback*);
@@ -80,6 +101,7 @@ private:
 
 bool can_library_init(const LibraryConfig& cfg = LibraryConfig());
 bool can_library_release();
+const LibraryConfig& can_library_config();
 
 CanInterface* create_can_interface(CanInterface::Callback*);
 void delete_can_interface(CanInterface*);
@@ -15,8 +15,8 @@ namespace can {
 std::atomic_uint64_t CanPacket::_unique_counter(0LLU);
 std::atomic_uint64_t CanMessage::_unique_counter(0LLU);
 
-allocator<CanMessage,255*7>* CanMessage::_big_msg_allocator = nullptr;
-allocator<CanMessage,8>* CanMessage::_small_msg_allocator = nullptr;
+std::array<pool_allocator*,MAX_MESSAGE_SIZE_CLASSES> CanMessage::_msg_allocators{};
+size_t CanMessage::_msg_allocators_count = 0;
 
 
 /**
@@ -27,14 +27,51 @@ allocator<CanMessage,8>* CanMessage::_small_msg_allocator = nullptr;
  */
 void CanMessage::operator delete(void* ptr)
 {
-  if ((_big_msg_allocator == nullptr) || (_small_msg_allocator == nullptr))
+  if (_msg_allocators_count == 0)
     throw std::runtime_error("Library is not properly initialized");
 
-  if (!_small_msg_allocator->free(ptr) && 
-      !_big_msg_allocator->free(ptr))
+  // Each pool owns a contiguous arena, so these are plain range checks
+  for (size_t index = 0; index < _msg_allocators_count; index++)
   {
-    ::free(ptr);
+    if (_msg_allocators[index]->free(ptr))
+      return;
   }
+  ::free(ptr);
+}
+
+/**
+ * \fn  CanMessage::allocate
+ *
+ *  Takes a slot from the smallest size class that fits length bytes of
+ *  payload. Falls back to the heap when the class is exhausted or when
+ *  length is above the largest class.
+ *
+ * @param  length : uint32_t 
+ * @return  CanMessage*
+ */
+CanMessage* CanMessage::allocate(uint32_t length)
+{
+  if (_msg_allocators_count == 0)
+    throw std::runtime_error("Library is not properly initialized");
+
+  CanMessage* msg = nullptr;
+  size_t size = sizeof(CanMessage) + length;
+  for (size_t index = 0; index < _msg_allocators_count; index++)
+  {
+    if (size <= _msg_allocators[index]->slot_size())
+    {
+      msg = reinterpret_cast<CanMessage*>(_msg_allocators[index]->allocate());
+      break;
+    }
+  }
+
+  if (msg == nullptr)
+    msg = reinterpret_cast<CanMessage*>(::malloc(size));
+
+  if (msg == nullptr)
+    throw std::bad_alloc();
+
+  return msg;
 }
 
 
@@ -50,25 +87,7 @@ CanMessagePtr::CanMessagePtr(const std::initializer_list<uint8_t>& data, uint32_
                         uint8_t priority /*= DEFAULT_CAN_PRIORITY*/,
                         CanMessage::ConfirmationCallback cback /*= CanMessage::ConfirmationCallback()*/)
 { 
-  if ((CanMessage::_big_msg_allocator == nullptr) || (CanMessage::_small_msg_allocator == nullptr))
-    throw std::runtime_error("Library is not properly initialized");
-
-  CanMessage* msg = nullptr;
-  if (data.size() <= 8)
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_small_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + 8));
-  }
-  else if (data.size() <= (255*7))
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_big_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + (255*7)));
-  }
-
-  if (msg == nullptr)
-    throw std::bad_alloc();
+  CanMessage* msg = CanMessage::allocate(static_cast<uint32_t>(data.size()));
 
   ::new (msg) CanMessage(data.begin(), data.size(), pgn, priority, cback);
   reset(msg);
@@ -87,25 +106,7 @@ CanMessagePtr::CanMessagePtr(const uint8_t* data,uint32_t length, uint32_t pgn,
                         uint8_t priority/* = DEFAULT_CAN_PRIORITY*/,
                         CanMessage::ConfirmationCallback cback /*= CanMessage::ConfirmationCallback()*/)
 { 
-  if ((CanMessage::_big_msg_allocator == nullptr) || (CanMessage::_small_msg_allocator == nullptr))
-    throw std::runtime_error("Library is not properly initialized");
-
-  CanMessage* msg = nullptr;
-  if (length <= 8)
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_small_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + 8));
-  }
-  else if (length <= (255*7))
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_big_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + (255*7)));
-  }
-
-  if (msg == nullptr)
-    throw std::bad_alloc();
+  CanMessage* msg = CanMessage::allocate(length);
 
   ::new (msg) CanMessage(data, length, pgn, priority, cback);
   reset(msg);
@@ -123,27 +124,30 @@ CanMessagePtr::CanMessagePtr(uint32_t length, uint32_t pgn,
                         uint8_t priority/* = DEFAULT_CAN_PRIORITY*/,
                         CanMessage::ConfirmationCallback cback /*= CanMessage::ConfirmationCallback()*/)
 { 
-  if ((CanMessage::_big_msg_allocator == nullptr) || (CanMessage::_small_msg_allocator == nullptr))
-    throw std::runtime_error("Library is not properly initialized");
+  CanMessage* msg = CanMessage::allocate(length);
 
-  CanMessage* msg = nullptr;
-  if (length <= 8)
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_small_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + 8));
-  }
-  else if (length <= (255*7))
-  {
-    msg = reinterpret_cast<CanMessage*>(CanMessage::_big_msg_allocator->allocate());
-    if (msg == nullptr)
-      msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + (255*7)));
-  }
+  ::new (msg) CanMessage(nullptr, length, pgn, priority, cback);
+  reset(msg);
+}
 
-  if (msg == nullptr)
-    throw std::bad_alloc();
 
-  ::new (msg) CanMessage(nullptr, length, pgn, priority, cback);
+/**
+ * \fn  constructor CanMessagePtr::CanMessagePtr
+ *
+ *  The payload is not copied, the message refers to the caller's buffer
+ *
+ * @param  buffer :  const CanBuffer& 
+ * @param  pgn :  uint32_t 
+ * @param  priority :  uint8_t 
+ * @param   cback :  CanMessage::ConfirmationCallback
+ */
+CanMessagePtr::CanMessagePtr(const CanBuffer& buffer, uint32_t pgn, 
+                        uint8_t priority/* = DEFAULT_CAN_PRIORITY*/,
+                        CanMessage::ConfirmationCallback cback /*= CanMessage::ConfirmationCallback()*/)
+{ 
+  CanMessage* msg = CanMessage::allocate(0);
+
+  ::new (msg) CanMessage(buffer, pgn, priority, cback);
   reset(msg);
 }
 
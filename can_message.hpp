@@ -59,12 +59,7 @@ public:
     memcpy(_data, data, _dlc);
     _unique_id = _unique_counter++;
 
-    _id = ((priority & 7) << 26) | ((pgn & 0x3FFFF) << 8) | sa;
-    if (is_pdu1())
-    {
-      _id &= ~0xFF00;
-      _id |= (da << 8);
-    }
+    _id = make_id(pgn, da, sa, priority);
   }
 
   /**
@@ -83,12 +78,30 @@ public:
     memcpy(_data, data.begin(), _dlc);
     _unique_id = _unique_counter++;
 
-    _id = ((priority & 7) << 26) | ((pgn & 0x3FFFF) << 8) | sa;
-    if (is_pdu1())
+    _id = make_id(pgn, da, sa, priority);
+  }
+
+  /**
+   * \fn  CanPacket::make_id
+   *
+   *  29 bit identifier, senders of many frames with the same PGN and
+   *  addresses compute it once
+   *
+   * @param  pgn : uint32_t
+   * @param  da : uint8_t
+   * @param  sa : uint8_t
+   * @param  priority : uint8_t
+   * @return  uint32_t
+   */
+  static    uint32_t              make_id(uint32_t pgn, uint8_t da, uint8_t sa, uint8_t priority = DEFAULT_CAN_PRIORITY)
+  {
+    uint32_t id = ((priority & 7) << 26) | ((pgn & 0x3FFFF) << 8) | sa;
+    if (((id >> 16) & 0xFF) < 240)
     {
-      _id &= ~0xFF00;
-      _id |= (da << 8);
+      id &= ~0xFF00;
+      id |= (da << 8);
     }
+    return id;
   }
 
             uint32_t              id() const { return _id; }
@@ -115,6 +128,41 @@ private:
 };
 
 
+/**
+ * \class CanBufferProvider
+ *
+ *  Application owned storage for received multi packet messages.
+ *  Reassembly writes straight into the acquired memory and the
+ *  completed message is a view of it. release is called once the
+ *  last reference to that message is gone.
+ */
+class CanBufferProvider
+{
+public:
+  virtual ~CanBufferProvider() {}
+
+  // nullptr lets the library allocate the message itself
+  virtual uint8_t*                acquire(uint32_t pgn, uint32_t length, CanBusHandle bus) = 0;
+  virtual void                    release(uint8_t* data, uint32_t length) = 0;
+};
+
+/**
+ * \struct CanBuffer
+ *
+ *  Caller owned payload storage for large (ETP) messages. The message
+ *  only references the buffer, so it has to stay valid until the message
+ *  is released. Buffers with a provider are handed back to it then.
+ */
+struct CanBuffer
+{
+  CanBuffer(uint8_t* data, uint32_t size, CanBufferProvider* provider = nullptr)
+  : _data(data), _size(size), _provider(provider) {}
+
+  uint8_t*                        _data;
+  uint32_t                        _size;
+  CanBufferProvider*              _provider;
+};
+
 class CanMessagePtr;
 /**
  * \class CanMessage
@@ -136,14 +184,31 @@ private:
   , _priority(priority)
   , _unique_id(_unique_counter++)
   , _cback(cback)
+  , _buffer(_data)
   , _size(length)
+  , _provider(nullptr)
   {  
     if (data != nullptr)
       memcpy(_data, data, _size);
   }
 
+  explicit CanMessage(const CanBuffer& buffer, uint32_t pgn
+            , uint8_t priority = DEFAULT_CAN_PRIORITY,ConfirmationCallback cback = ConfirmationCallback())
+  : _pgn(pgn)
+  , _priority(priority)
+  , _unique_id(_unique_counter++)
+  , _cback(cback)
+  , _buffer(buffer._data)
+  , _size(buffer._size)
+  , _provider(buffer._provider)
+  {  }
+
 public:
-  ~CanMessage() {}
+  ~CanMessage() 
+  {
+    if (_provider != nullptr)
+      _provider->release(_buffer, _size);
+  }
 
           uint32_t                pgn() const { return _pgn; }
           uint8_t                 priority() const { return _priority; }
@@ -154,8 +219,9 @@ public:
           bool                    is_pdu1() const { return (pf() < 240); }
           bool                    is_pdu2() const { return (pf() >= 240); }
   
-          const uint8_t*          data() const { return _data; }
-          uint8_t*                data() { return _data; }
+          const uint8_t*          data() const { return _buffer; }
+          uint8_t*                data() { return _buffer; }
+          bool                    is_external() const { return (_buffer != _data); }
 
           uint32_t                length() const { return static_cast<uint32_t>(_size); }
 
@@ -171,8 +237,11 @@ public:
           void operator delete(void*);
 
 private:
-  static  allocator<CanMessage,255*7>*    _big_msg_allocator;
-  static  allocator<CanMessage,8>*        _small_msg_allocator;
+  static  CanMessage*             allocate(uint32_t length);
+
+  static  std::array<pool_allocator*,MAX_MESSAGE_SIZE_CLASSES>
+                                  _msg_allocators;
+  static  size_t                  _msg_allocators_count;
 
 private:
   uint32_t                        _pgn;
@@ -183,7 +252,10 @@ private:
 
   ConfirmationCallback            _cback;
 
+  // Points either to _data or to a caller provided CanBuffer
+  uint8_t*                        _buffer;
   uint32_t                        _size;
+  CanBufferProvider*              _provider;
   uint8_t                         _data[0];
 };
 
@@ -204,26 +276,7 @@ public:
   explicit CanMessagePtr(const std::array<uint8_t,_Size>& data, uint32_t pgn, uint8_t priority = DEFAULT_CAN_PRIORITY,
                         CanMessage::ConfirmationCallback cback = CanMessage::ConfirmationCallback()) 
   {
-    if ((CanMessage::_big_msg_allocator == nullptr) || (CanMessage::_small_msg_allocator == nullptr))
-      throw std::runtime_error("Library is not properly initialized");
-
-    CanMessage* msg = nullptr;
-    if (data.size() <= 8)
-    {
-      msg = reinterpret_cast<CanMessage*>(CanMessage::_small_msg_allocator->allocate());
-      if (msg == nullptr)
-        msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + 8));
-    }
-    else if (data.size() <= (255*7))
-    {
-      msg = reinterpret_cast<CanMessage*>(CanMessage::_big_msg_allocator->allocate());
-      if (msg == nullptr)
-        msg = reinterpret_cast<CanMessage*>(::malloc(sizeof(CanMessage) + (255*7)));
-    }
-
-    if (msg == nullptr)
-      throw std::bad_alloc();
-
+    CanMessage* msg = CanMessage::allocate(static_cast<uint32_t>(data.size()));
     ::new (msg) CanMessage(data.begin(), data.size(), pgn, priority, cback);
     reset(msg);
   }
@@ -237,6 +290,9 @@ public:
   explicit CanMessagePtr(uint32_t length, uint32_t pgn, uint8_t priority = DEFAULT_CAN_PRIORITY,
                         CanMessage::ConfirmationCallback cback = CanMessage::ConfirmationCallback());
 
+  explicit CanMessagePtr(const CanBuffer& buffer, uint32_t pgn, uint8_t priority = DEFAULT_CAN_PRIORITY,
+                        CanMessage::ConfirmationCallback cback = CanMessage::ConfirmationCallback());
+
 };
 
 } // can
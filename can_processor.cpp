@@ -9,7 +9,11 @@
 #include "can_processor.hpp"  
 #include "can_transport_protocol.hpp"
 #include "can_transcoder_ack.hpp"
+#ifdef CAN_LIBRARY_RX_PIPELINE
+#include "can_rx_pipeline.hpp"
+#endif
 
+#include <algorithm>
 #include <mutex>
 
 namespace brt {
@@ -25,7 +29,21 @@ CanProcessor::CanProcessor(Callback* cback)
 , _mutex(this)
 , _device_db(this)
 , _remote_name_counter(0)
+, _rx_pipeline(nullptr)
+, _rx_buffer_provider(nullptr)
+, _timer_mutex(this)
+, _fast_packet(nullptr)
+, _confirm_mutex(this)
 {
+#ifdef CAN_LIBRARY_RX_PIPELINE
+  if (can_library_config()._rx_worker_threads != 0)
+    _rx_pipeline = new CanRxPipeline(this, can_library_config()._rx_worker_threads);
+#endif
+
+  _fast_packet = new FastPacketProtocol(this);
+
+  // Fast Packet first, it frames every message of a registered PGN
+  _transport_stack.push(CanProtocolPtr(_fast_packet));
   _transport_stack.push(CanProtocolPtr(new SimpleTransport(this)));
   _transport_stack.push(CanProtocolPtr(new CanTransportProtocol(this)));
 }
@@ -36,135 +54,241 @@ CanProcessor::CanProcessor(Callback* cback)
  */
 CanProcessor::~CanProcessor()
 {
+#ifdef CAN_LIBRARY_RX_PIPELINE
+  // Stop the workers before anything they use goes away
+  if (_rx_pipeline != nullptr)
+    delete _rx_pipeline;
+#endif
 }
 
 
 /**
  * \fn  CanProcessor::update
  *
+ *  Runs the expired timers and the periodic work
+ *
+ * @return  uint64_t time on the get_time_tick_nanoseconds clock by which
+ *          update has to be called again, CAN_NO_DEADLINE if nothing is
+ *          pending
  */
-void CanProcessor::update()
+uint64_t CanProcessor::update()
 {
   uint64_t time_tick = get_time_tick();
 
+  // Expired timers, callbacks may arm timers again
+  for (;;)
   {
-    std::lock_guard<RecursiveMutex> l(_mutex);
-    // Call all updaters
-    for (auto updater : _updaters)
+    TimerCallback fn;
     {
-      if (updater)
-        updater();
+      std::lock_guard<Mutex> l(_timer_mutex);
+      if (!_timers.pop_expired(time_tick, fn))
+        break;
     }
 
-    // Check buses
-    for (auto& bus : _bus_map)
+    if (fn)
+      fn();
+  }
+
+  uint64_t deadline;
+  {
+    std::lock_guard<Mutex> l(_timer_mutex);
+    deadline = _timers.next_deadline();
+  }
+
+  // Call all updaters outside the lock, an updater returning true is done
+  fixed_list<UpdateCallback,32> updaters;
+  {
+    std::lock_guard<RecursiveMutex> l(_mutex);
+    for (auto& fn : _updaters)
+      updaters.push(fn);
+
+    _updaters.clear();
+  }
+
+  for (auto iter = updaters.begin(); iter != updaters.end(); )
+  {
+    if (!(*iter) || (*iter)())
+      iter = updaters.erase(iter);
+    else
+      iter++;
+  }
+
+  if (!updaters.empty())
+  {
+    std::lock_guard<RecursiveMutex> l(_mutex);
+    for (auto& fn : updaters)
+      _updaters.push(fn);
+
+    deadline = time_tick + 1;
+  }
+
+  // Check buses
+  fixed_list<CanBusHandle,MAX_CAN_BUSES> handles;
+  get_all_buses(handles);
+  for (auto handle : handles)
+  {
+    bool activated = false, drain = false;
     {
+      std::lock_guard<RecursiveMutex> l(*bus_mutex(handle));
+      Bus& bus = *_bus_map.at(handle);
       if (bus._status == eBusActivating)
       {
         if ((time_tick - bus._time_tag) >= CAN_ADDRESS_CLAIMED_WAITING_TIME)
         {
           bus._status = eBusActive;
-          for (auto iter = bus._bus_callbacks.begin(); iter != bus._bus_callbacks.end(); )
-          {
-            if ((*iter) && (*iter)(bus._bus_name, bus._status))
-              iter = bus._bus_callbacks.erase(iter);
-            else
-              iter++;
-          }
+          activated = true;
         }
+        else
+          deadline = std::min<uint64_t>(deadline, bus._time_tag + CAN_ADDRESS_CLAIMED_WAITING_TIME);
       }
 
-      if (bus._status == eBusActive)
+      // Queued packets go out with no lock held, whoever starts draining
+      // the bus sends everything queued behind it
+      if ((bus._status == eBusActive) && !bus._draining && !bus._packet_fifo.empty())
       {
-        while (!bus._packet_fifo.empty())
-        {
-          cback()->send_can_packet(bus._bus_name, bus._packet_fifo.front());
-          bus._packet_fifo.pop();
-        }
+        bus._draining = true;
+        drain = true;
       }
     }
+
+    if (drain)
+      transmit(handle, nullptr, 0);
+
+    if (activated)
+      notify_bus(handle, eBusActive);
   }
+
+  if (deadline == CAN_NO_DEADLINE)
+    return CAN_NO_DEADLINE;
+
+  return std::max(deadline, time_tick) * 1000000llu;
 }
 
 /**
  * \fn  CanProcessor::register_can_bus
  *
+ * The slot handle is available through get_bus_handle afterwards
+ *
  * @param  bus : const std::string&
  * @return  bool
  */
 bool CanProcessor::register_can_bus(const ConstantString& bus_name)
 {
-  {
-    std::lock_guard<RecursiveMutex> l(_mutex);
-    if (_bus_map.find_if([bus_name](const Bus& bus)->bool
-             { return bus._bus_name == bus_name;}) != _bus_map.end())
-    {
-      return false;
-    }
-  }
-
   // Request for address Claimed
   CanPacket packet({00,0xEE,00}, PGN_Request, BROADCAST_CAN_ADDRESS, NULL_CAN_ADDRESS);
 
   Bus bus;
   bus._bus_name       = bus_name;
   bus._status         = eBusWaitForSuccesfullTX;
+  bus._draining       = false;
   bus._time_tag       = get_time_tick();
   bus._initial_packet_id = packet.unique_id();
 
+  CanBusHandle handle = INVALID_CAN_BUS_HANDLE;
   {
     std::lock_guard<RecursiveMutex> l(_mutex);
+    if (_bus_map.find_if([bus_name](const Bus& bus)->bool
+             { return bus._bus_name == bus_name;}) != _bus_map.end())
+    {
+      return false;
+    }
+
     auto result = _bus_map.push(bus);
     if (result == _bus_map.end())
       return false;
+
+    handle = static_cast<CanBusHandle>(_bus_map.index(result));
+    _bus_mutex[handle].reset(new RecursiveMutex(this));
  
     // Register callback for this message to process BUS activation 
-    _confirm_callbacks.push(PacketConfirmation(packet.unique_id(),
-           [this](uint64_t packet_id,CanMessageConfirmation status) 
-      {
-        std::lock_guard<RecursiveMutex> l(_mutex);
-        for (auto& bus : _bus_map)
+    {
+      std::lock_guard<Mutex> lc(_confirm_mutex);
+      _confirm_callbacks.push(PacketConfirmation(packet.unique_id(),
+             [this, handle](uint64_t packet_id,CanMessageConfirmation status) 
         {
-          if ((bus._status == eBusWaitForSuccesfullTX) &&
-              (bus._initial_packet_id == packet_id))
+          CanBusStatus bus_status;
           {
-            if (status == eMessageSent)
-              bus._status = eBusActivating;
-            else
-              bus._status = eBusInactive;
-              
-            bus._time_tag = get_time_tick();
-            for (auto iter = bus._bus_callbacks.begin(); iter != bus._bus_callbacks.end(); )
+            std::lock_guard<RecursiveMutex> l(*bus_mutex(handle));
+            auto bus = _bus_map.at(handle);
+            if ((bus->_status != eBusWaitForSuccesfullTX) ||
+                (bus->_initial_packet_id != packet_id))
             {
-              if ((*iter) && (*iter)(bus._bus_name, bus._status))
-                iter = bus._bus_callbacks.erase(iter);
-              else
-                iter++;
+              return;
             }
-            break;
+
+            if (status == eMessageSent)
+              bus->_status = eBusActivating;
+            else
+              bus->_status = eBusInactive;
+            
+            bus->_time_tag = get_time_tick();
+            bus_status = bus->_status;
           }
-        }
-      }));
+
+          notify_bus(handle, bus_status);
+        }));
+    }
 
     if (_bus_map.size() == 1)
     {
-      register_pgn_receiver(PGN_Request,[this](const CanPacket& packet,const ConstantString& bus_name)
-      {  on_request(packet,bus_name); });
+      register_pgn_receiver(PGN_Request,[this](const CanPacket& packet,CanBusHandle bus)
+      {  on_request(packet,bus); });
     }
   }
 
-  _device_db.create_bus(bus_name);
+  _device_db.create_bus(bus_name, handle);
+#ifdef CAN_LIBRARY_RX_PIPELINE
+  if (_rx_pipeline != nullptr)
+    _rx_pipeline->add_bus(handle);
+#endif
+
   cback()->send_can_packet(bus_name, packet);
   return true;
 }
 
+/**
+ * \fn  CanProcessor::get_bus_handle
+ *
+ * @param  bus_name : const ConstantString&
+ * @return  CanBusHandle
+ */
+CanBusHandle CanProcessor::get_bus_handle(const ConstantString& bus_name) const
+{
+  std::lock_guard<RecursiveMutex> l(_mutex);
+  auto iter = _bus_map.find_if([bus_name](const Bus& bus)->bool
+      { return bus._bus_name == bus_name;});
+
+  if (iter == _bus_map.end())
+    return INVALID_CAN_BUS_HANDLE;
+
+  return static_cast<CanBusHandle>(_bus_map.index(iter));
+}
+
+/**
+ * \fn  CanProcessor::get_bus_name
+ *
+ * Bus slots are never released, so the returned string stays valid
+ * for the lifetime of the processor
+ *
+ * @param  bus : CanBusHandle
+ * @return  ConstantString
+ */
+ConstantString CanProcessor::get_bus_name(CanBusHandle bus) const
+{
+  auto iter = _bus_map.at(bus);
+  if (iter == _bus_map.end())
+    return ConstantString();
+
+  return ConstantString(iter->_bus_name);
+}
+
 /**
  * \fn  CanProcessor::on_request
  *
  * @param  packet : const CanPacket& 
- * @param  bus_name : const ConstantString&
+ * @param  bus : CanBusHandle
  */
-void CanProcessor::on_request(const CanPacket& packet,const ConstantString& bus_name)
+void CanProcessor::on_request(const CanPacket& packet,CanBusHandle bus)
 {
   if (packet.dlc() < 3)
     return;
@@ -176,25 +300,25 @@ void CanProcessor::on_request(const CanPacket& packet,const ConstantString& bus_
     if (packet.is_broadcast())
     {
       fixed_list<LocalECUPtr> ecus;
-      _device_db.get_local_ecus(ecus, { bus_name });
+      _device_db.get_local_ecus(ecus, bus);
       for (auto ecu : ecus)
       {
         if (ecu)
-          ecu->claim_address(ecu->get_address(bus_name), bus_name);
+          ecu->claim_address(ecu->get_address(bus), bus);
       }
     }
     else
     {
-      LocalECUPtr ecu(_device_db.get_ecu_by_address(packet.da(), bus_name));
+      LocalECUPtr ecu(_device_db.get_ecu_by_address(packet.da(), bus));
       if (ecu)
-        ecu->claim_address(ecu->get_address(bus_name), bus_name);
+        ecu->claim_address(ecu->get_address(bus), bus);
     }
   }
   else
   {
-    RemoteECUPtr remote(_device_db.get_ecu_by_address(packet.sa(), bus_name));
+    RemoteECUPtr remote(_device_db.get_ecu_by_address(packet.sa(), bus));
     if (!remote)
-      remote = register_abstract_remote_ecu(packet.sa(), bus_name);
+      remote = register_abstract_remote_ecu(packet.sa(), bus);
     
     if (!remote)
       return; // 
@@ -202,17 +326,17 @@ void CanProcessor::on_request(const CanPacket& packet,const ConstantString& bus_
     if (packet.is_broadcast())
     {
       fixed_list<LocalECUPtr> ecus;
-      _device_db.get_local_ecus(ecus, { bus_name });
+      _device_db.get_local_ecus(ecus, bus);
       for (auto local : ecus)
       {
         CanMessagePtr msg = local->request_pgn(pgn);
         if (msg)
-          send_can_message(msg, local, remote, { bus_name });
+          send_can_message(msg, local, remote, bus);
       }
     }
     else
     {
-      LocalECUPtr local(_device_db.get_ecu_by_address(packet.da(), bus_name));
+      LocalECUPtr local(_device_db.get_ecu_by_address(packet.da(), bus));
       if (!local)
         return;
       
@@ -221,7 +345,7 @@ void CanProcessor::on_request(const CanPacket& packet,const ConstantString& bus_
         msg = CanTranscoderAck(CanTranscoderAck::Nack, packet.sa(), pgn).create_message();
 
       if (msg)
-        send_can_message(msg, local, remote, { bus_name });
+        send_can_message(msg, local, remote, bus);
     }
   }
 }
@@ -234,14 +358,23 @@ void CanProcessor::on_request(const CanPacket& packet,const ConstantString& bus_
  */
 CanBusStatus CanProcessor::get_bus_status(const ConstantString& bus_name) const
 {
-  std::lock_guard<RecursiveMutex> l(_mutex);
-  auto iter = _bus_map.find_if([bus_name](const Bus& bus)->bool
-      { return bus._bus_name == bus_name;});
+  return get_bus_status(get_bus_handle(bus_name));
+}
 
-  if (iter == _bus_map.end())
+/**
+ * \fn  CanProcessor::get_bus_status
+ *
+ * @param  bus : CanBusHandle
+ * @return  CanBusStatus
+ */
+CanBusStatus CanProcessor::get_bus_status(CanBusHandle bus) const
+{
+  RecursiveMutex* mutex = bus_mutex(bus);
+  if (mutex == nullptr)
     return eBusInactive;
 
-  return iter->_status;
+  std::lock_guard<RecursiveMutex> l(*mutex);
+  return _bus_map.at(bus)->_status;
 }
 
 /**
@@ -252,7 +385,7 @@ CanBusStatus CanProcessor::get_bus_status(const ConstantString& bus_name) const
  */
 LocalECUPtr CanProcessor::create_local_ecu(const CanName& name)
 {
-  CanECUPtr ecu = _device_db.get_ecu_by_name(name,"");
+  CanECUPtr ecu = _device_db.get_ecu_by_name(name);
   if (ecu)
     return LocalECUPtr(ecu);
 
@@ -263,23 +396,17 @@ LocalECUPtr CanProcessor::create_local_ecu(const CanName& name)
  * \fn  CanProcessor::activate_local_ecu
  *
  * @param   ecu : const LocalECUPtr&
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param  desired_address  :  uint8_t
  * @return  bool
  */
-bool CanProcessor::activate_local_ecu(const LocalECUPtr& ecu, const ConstantString& bus_name,
+bool CanProcessor::activate_local_ecu(const LocalECUPtr& ecu, CanBusHandle bus,
                         uint8_t desired_address /*= BROADCAST_CAN_ADDRESS*/)
 {
-  {
-    std::lock_guard<RecursiveMutex> l(_mutex);
-    if (_bus_map.find_if([bus_name](const Bus& bus)->bool
-            { return bus._bus_name == bus_name; }) == _bus_map.end())
-    {
-      return false;
-    }
-  }
+  if (bus_mutex(bus) == nullptr)
+    return false;
 
-  return _device_db.add_local_ecu(ecu, bus_name, desired_address);
+  return _device_db.add_local_ecu(ecu, bus, desired_address);
 }
 
 /**
@@ -289,8 +416,23 @@ bool CanProcessor::activate_local_ecu(const LocalECUPtr& ecu, const ConstantStri
  * @param   bus : const ConstantString&
  * @return  RemoteECUPtr
  */
-RemoteECUPtr CanProcessor::register_abstract_remote_ecu(uint8_t address,const ConstantString& bus)
+RemoteECUPtr CanProcessor::register_abstract_remote_ecu(uint8_t address,const ConstantString& bus_name)
 {
+  return register_abstract_remote_ecu(address, get_bus_handle(bus_name));
+}
+
+/**
+ * \fn  CanProcessor::register_abstract_remote_ecu
+ *
+ * @param  address : uint8_t 
+ * @param  bus : CanBusHandle
+ * @return  RemoteECUPtr
+ */
+RemoteECUPtr CanProcessor::register_abstract_remote_ecu(uint8_t address,CanBusHandle bus)
+{
+  if (bus == INVALID_CAN_BUS_HANDLE)
+    return RemoteECUPtr();
+
   CanName name(_remote_name_counter++);
   RemoteECUPtr remote(this, name);
   if (!_device_db.add_remote_abstract_ecu(remote, bus, address))
@@ -320,10 +462,11 @@ bool CanProcessor::destroy_local_ecu(const CanName& name)
 {
   size_t num = 0;
   
-  std::lock_guard<RecursiveMutex> l(_mutex);
-  for (auto bus : _bus_map)
+  fixed_list<CanBusHandle,MAX_CAN_BUSES> handles;
+  get_all_buses(handles);
+  for (auto handle : handles)
   {
-    if (device_db().remove_local_ecu(name,bus._bus_name))
+    if (device_db().remove_local_ecu(name, handle))
       num++;
   }
   return (num != 0);
@@ -337,34 +480,161 @@ bool CanProcessor::destroy_local_ecu(const CanName& name)
  * @return  bool
  */
 bool CanProcessor::received_can_packet(const CanPacket& packet,const ConstantString& bus_name)
+{
+  return received_can_packet(packet, get_bus_handle(bus_name));
+}
+
+/**
+ * \fn  CanProcessor::received_can_packet
+ *
+ *  In pipelined mode the packet is only queued and true means it was
+ *  accepted by the ingress ring
+ *
+ * @param   packet : const CanPacket&
+ * @param   bus : CanBusHandle
+ * @return  bool
+ */
+bool CanProcessor::received_can_packet(const CanPacket& packet,CanBusHandle bus)
+{
+  if (bus == INVALID_CAN_BUS_HANDLE)
+    return false;
+
+#ifdef CAN_LIBRARY_RX_PIPELINE
+  if (_rx_pipeline != nullptr)
+    return _rx_pipeline->enqueue(packet, bus);
+#endif
+
+  EcuMemo memo(_device_db, bus);
+  return process_can_packet(packet, bus, memo);
+}
+
+/**
+ * \fn  CanProcessor::received_can_packets
+ *
+ * @param   packets : const CanPacket*
+ * @param   count : size_t
+ * @param   bus_name : const ConstantString&
+ * @return  size_t
+ */
+size_t CanProcessor::received_can_packets(const CanPacket* packets,size_t count,const ConstantString& bus_name)
+{
+  return received_can_packets(packets, count, get_bus_handle(bus_name));
+}
+
+/**
+ * \fn  CanProcessor::received_can_packets
+ *
+ *  Burst version of received_can_packet. The bus is checked once and
+ *  device DB lookups are shared across the burst. In pipelined mode the
+ *  burst is pushed into the ingress ring as a batch.
+ *
+ * @param   packets : const CanPacket*
+ * @param   count : size_t
+ * @param   bus : CanBusHandle
+ * @return  size_t number of accepted packets
+ */
+size_t CanProcessor::received_can_packets(const CanPacket* packets,size_t count,CanBusHandle bus)
+{
+  if ((bus == INVALID_CAN_BUS_HANDLE) || (packets == nullptr))
+    return 0;
+
+#ifdef CAN_LIBRARY_RX_PIPELINE
+  if (_rx_pipeline != nullptr)
+    return _rx_pipeline->enqueue(packets, count, bus);
+#endif
+
+  return process_can_packets(packets, count, bus);
+}
+
+/**
+ * \fn  CanProcessor::process_can_packets
+ *
+ * @param   packets : const CanPacket*
+ * @param   count : size_t
+ * @param   bus : CanBusHandle
+ * @return  size_t number of accepted packets
+ */
+size_t CanProcessor::process_can_packets(const CanPacket* packets,size_t count,CanBusHandle bus)
+{
+  size_t result = 0;
+  EcuMemo memo(_device_db, bus);
+  for (size_t index = 0; index < count; index++)
+  {
+    if (process_can_packet(packets[index], bus, memo))
+      result++;
+  }
+  return result;
+}
+
+/**
+ * \fn  constructor CanProcessor::EcuMemo::EcuMemo
+ *
+ * @param  db : const CanDeviceDatabase&
+ * @param  bus : CanBusHandle
+ */
+CanProcessor::EcuMemo::EcuMemo(const CanDeviceDatabase& db, CanBusHandle bus)
+: _db(db)
+, _bus(bus)
+, _generation(db.generation())
+{
+  _address.fill(_empty);
+}
+
+/**
+ * \fn  CanProcessor::EcuMemo::get
+ *
+ * @param  address : uint8_t 
+ * @return  CanECUPtr
+ */
+CanECUPtr CanProcessor::EcuMemo::get(uint8_t address)
+{
+  uint32_t generation = _db.generation();
+  if (generation != _generation)
+  {
+    _address.fill(_empty);
+    _generation = generation;
+  }
+
+  size_t slot = address % _size;
+  if (_address[slot] != address)
+  {
+    _ecu[slot] = _db.get_ecu_by_address(address, _bus);
+    _address[slot] = address;
+  }
+  return _ecu[slot];
+}
+
+/**
+ * \fn  CanProcessor::process_can_packet
+ *
+ * @param   packet : const CanPacket&
+ * @param   bus : CanBusHandle
+ * @param   memo : EcuMemo&
+ * @return  bool
+ */
+bool CanProcessor::process_can_packet(const CanPacket& packet,CanBusHandle bus,EcuMemo& memo)
 {
   LocalECUPtr   local;
   if (!packet.is_broadcast())
   {
     // First we need to check whether this packet is sent to any of our local devices
-    local = LocalECUPtr(_device_db.get_ecu_by_address(packet.da(), bus_name));
+    local = LocalECUPtr(memo.get(packet.da()));
     if (!local)
       return false; // Not our message
   }
 
+  // Now check whether the PGN belongs to one of the listeners e.g Request Address Claimed, TP, ETP
+  if (_pgn_receivers.for_each(packet.pgn(), [&packet, bus](const PGNCallback& receiver)
+      { receiver(packet, bus); }) != 0)
   {
-    // Now check whether the PGN belongs to one of the listeners e.g Request Address Claimed, TP, ETP
-    std::lock_guard<RecursiveMutex> l(_mutex);
-    auto pgn_receiver = _pgn_receivers.find_if([packet](const PgnReceiver& receiver)->bool
-        { return packet.pgn() == receiver.first; });
-
-    if (pgn_receiver != _pgn_receivers.end())
-    {
-      pgn_receiver->second(packet, bus_name);
-      return true;
-    }
+    return true;
   }
 
   RemoteECUPtr  remote;
   if (packet.sa() < NULL_CAN_ADDRESS)
-    remote = RemoteECUPtr(_device_db.get_ecu_by_address(packet.sa(), bus_name));
+    remote = RemoteECUPtr(memo.get(packet.sa()));
 
-  message_received(CanMessagePtr(packet.data(), packet.dlc(), packet.pgn(), packet.priority()), local, remote, bus_name);
+  message_received(CanMessagePtr(packet.data(), packet.dlc(), packet.pgn(), packet.priority()), local, remote, bus);
   return true;
 }
 
@@ -383,61 +653,96 @@ bool CanProcessor::send_can_message(const CanMessagePtr& message,const LocalECUP
   if (!local)
     return false;
 
-  fixed_list<ConstantString,32> bss(buses);
-
-  if (bss.empty())
+  fixed_list<CanBusHandle,MAX_CAN_BUSES> bss;
+  if (buses.size() == 0)
     get_all_buses(bss);
-
-  bool result = false;
-  for (auto bus_name : bss)
+  else
   {
-    if (remote && remote->queue_message(message, local, bus_name))
-      continue;
-
-    for (auto transport : _transport_stack)
+    for (auto bus_name : buses)
     {
-      if (transport->send_message(message, local, remote, bus_name))
-      {
-        result = true;
-        break;
-      }
+      CanBusHandle bus = get_bus_handle(bus_name);
+      if (bus != INVALID_CAN_BUS_HANDLE)
+        bss.push(bus);
     }
   }
 
+  bool result = false;
+  for (auto bus : bss)
+  {
+    if (send_can_message(message, local, remote, bus))
+      result = true;
+  }
+
   return result;
 }
 
+/**
+ * \fn  CanProcessor::send_can_message
+ *
+ * @param   message : const CanMessagePtr&
+ * @param   local : const LocalECUPtr&
+ * @param   remote : const RemoteECUPtr&
+ * @param   bus : CanBusHandle
+ * @return  bool
+ */
+bool CanProcessor::send_can_message(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,
+                            CanBusHandle bus)
+{
+  if (!local || (bus == INVALID_CAN_BUS_HANDLE))
+    return false;
+
+  if (remote && remote->queue_message(message, local, bus))
+    return false;
+
+  for (auto transport : _transport_stack)
+  {
+    if (transport->send_message(message, local, remote, bus))
+      return true;
+  }
+
+  return false;
+}
+
 /**
  * \fn  CanProcessor::message_received
  *
  * @param   message : const CanMessagePtr&
  * @param   local : const LocalECUPtr&
  * @param   remote :  const RemoteECUPtr&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
 void CanProcessor::message_received(const CanMessagePtr& message,const LocalECUPtr& local,
-                                   const RemoteECUPtr& remote,const ConstantString& bus_name)
+                                   const RemoteECUPtr& remote,CanBusHandle bus)
 {
   if (remote && remote->on_message_received(message))
   {
     auto req = remote->get_requested_pgn(message->pgn());
     if (req)
     {
-      std::lock_guard<RecursiveMutex> l(_mutex);
-      for (auto iter = _requested_pgns.begin(); iter != _requested_pgns.end(); )
+      fixed_list<RequestCallback,32> callbacks;
       {
-        if ((iter->_pgn == message->pgn()) && (iter->_ecu == remote))
+        std::lock_guard<RecursiveMutex> l(_mutex);
+        for (auto iter = _requested_pgns.begin(); iter != _requested_pgns.end(); )
         {
-          iter->_callback(req);
-          iter = _requested_pgns.erase(iter);
+          if ((iter->_pgn == message->pgn()) && (iter->_ecu == remote))
+          {
+            // The rest is served by the next response
+            if (callbacks.push(iter->_callback) == callbacks.end())
+              break;
+
+            iter = _requested_pgns.erase(iter);
+          }
+          else
+            ++iter;
         }
-        else
-          ++iter;
       }
+
+      for (auto& callback : callbacks)
+        callback(req);
     }     
   }
   else
-    cback()->message_received(message, local, remote, bus_name);
+    cback()->message_received(message, local, remote, get_bus_name(bus));
 }
 
 /**
@@ -446,16 +751,16 @@ void CanProcessor::message_received(const CanMessagePtr& message,const LocalECUP
  * @param   message : const CanMessagePtr&
  * @param   local : const LocalECUPtr&
  * @param   remote :  const RemoteECUPtr&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  * @return  bool
  */
 bool CanProcessor::SimpleTransport::send_message(const CanMessagePtr& message,const LocalECUPtr& local, 
-                                                      const RemoteECUPtr& remote,const ConstantString& bus_name)
+                                                      const RemoteECUPtr& remote,CanBusHandle bus)
 {
   if (message->length() > 8)
     return false;
 
-  local->send_message(message, remote, bus_name);
+  local->send_message(message, remote, bus);
   return true;
 }
 
@@ -467,17 +772,23 @@ bool CanProcessor::SimpleTransport::send_message(const CanMessagePtr& message,co
  */
 void CanProcessor::can_packet_confirm(uint64_t packet_id,CanMessageConfirmation status)
 {
-  std::lock_guard<RecursiveMutex> l(_mutex);
-  auto iter = _confirm_callbacks.find_if([packet_id](const PacketConfirmation& cfrm)->bool
+  ConfirmationCallback callback;
   {
-    return cfrm._packet_id == packet_id;
-  });
+    std::lock_guard<Mutex> l(_confirm_mutex);
+    auto iter = _confirm_callbacks.find_if([packet_id](const PacketConfirmation& cfrm)->bool
+    {
+      return cfrm._packet_id == packet_id;
+    });
 
-  if ((iter != _confirm_callbacks.end()) && iter->_callback)
-  {
-    iter->_callback(packet_id, status);
+    if (iter == _confirm_callbacks.end())
+      return;
+
+    callback = std::move(iter->_callback);
     _confirm_callbacks.erase(iter);
   }
+
+  if (callback)
+    callback(packet_id, status);
 }
 
 /**
@@ -510,52 +821,143 @@ bool CanProcessor::request_pgn(uint32_t pgn,const LocalECUPtr& local,const Remot
     callback(req_pgn);
   else
   {
-    std::lock_guard<RecursiveMutex> l(_mutex);
-    _requested_pgns.push(RequestedPGNs(pgn,remote,callback));
+    {
+      std::lock_guard<RecursiveMutex> l(_mutex);
+      _requested_pgns.push(RequestedPGNs(pgn,remote,callback));
+    }
     send_can_message(CanMessagePtr(can_pack24(pgn),PGN_Request), local, remote);
   }
 
   return true;
 }
 
+/**
+ * \fn  CanProcessor::register_fast_packet_pgn
+ *
+ *  Messages of pgn longer than 8 bytes are sent and received with
+ *  NMEA 2000 Fast Packet instead of the transport protocol
+ *
+ * @param  pgn : uint32_t
+ */
+void CanProcessor::register_fast_packet_pgn(uint32_t pgn)
+{
+  _fast_packet->register_pgn(pgn);
+}
+
 /**
  * \fn  CanProcessor::send_raw_packet
  *
  * @param   packet : const CanPacket&
- * @param   bus_name : const ConstantString&
+ * @param   bus_handle : CanBusHandle
  * @param   fn :  const ConfirmationCallback&
  * @return  bool
  */
-bool CanProcessor::send_raw_packet(const CanPacket& packet,const ConstantString& bus_name,
+bool CanProcessor::send_raw_packet(const CanPacket& packet,CanBusHandle bus_handle,
                       const ConfirmationCallback& fn/* = ConfirmationCallback()*/)
 {
-  std::lock_guard<RecursiveMutex> l(_mutex);
-  auto bus = _bus_map.find_if([bus_name](const Bus& bus)->bool
-      { return bus._bus_name == bus_name; });
+  return send_raw_packets(&packet, 1, bus_handle, fn);
+}
 
-  if (bus == _bus_map.end())
+/**
+ * \fn  CanProcessor::send_raw_packets
+ *
+ *  Sends several frames to the same bus with one send_can_packets call.
+ *  fn, if set, is registered as confirmation for the last frame only,
+ *  the driver sends the frames in order. With confirm_each fn is
+ *  registered for every frame.
+ *
+ * @param  packets : const CanPacket*
+ * @param  count : size_t
+ * @param  bus_handle : CanBusHandle
+ * @param  fn : const ConfirmationCallback&
+ * @param  confirm_each : bool
+ * @return  bool
+ */
+bool CanProcessor::send_raw_packets(const CanPacket* packets,size_t count,CanBusHandle bus_handle,
+                      const ConfirmationCallback& fn/* = ConfirmationCallback()*/,
+                      bool confirm_each /*= false*/)
+{
+  RecursiveMutex* mutex = bus_mutex(bus_handle);
+  if (mutex == nullptr)
     return false;
 
-  if (bus->_status == eBusInactive)
-    return false;
+  {
+    std::lock_guard<RecursiveMutex> l(*mutex);
+    auto bus = _bus_map.at(bus_handle);
+    if (bus->_status == eBusInactive)
+      return false;
 
-  if (fn)
-    _confirm_callbacks.push(PacketConfirmation(packet.unique_id(), fn));
+    if (fn && (count != 0))
+    {
+      std::lock_guard<Mutex> lc(_confirm_mutex);
+      for (size_t index = confirm_each ? 0 : count - 1; index < count; index++)
+        _confirm_callbacks.push(PacketConfirmation(packets[index].unique_id(), fn));
+    }
 
-  if (bus->_status != eBusActive)
-  {
-    // There is a potential danger that remote device or
-    // local device will change its address on the bus while
-    // bus is in waiting state, however for this moment we consider
-    // the message is already on the bus - outside of address negotiation logic
-    bus->_packet_fifo.push(packet);
+    if ((bus->_status != eBusActive) || bus->_draining)
+    {
+      // There is a potential danger that remote device or
+      // local device will change its address on the bus while
+      // bus is in waiting state, however for this moment we consider
+      // the message is already on the bus - outside of address negotiation logic
+      for (size_t index = 0; index < count; index++)
+        bus->_packet_fifo.push(packets[index]);
+      return true;
+    }
+
+    if (count == 0)
+      return true;
+
+    bus->_draining = true;
   }
-  else
-    cback()->send_can_packet(bus_name,packet);
 
+  transmit(bus_handle, packets, count);
   return true;
 }
 
+/**
+ * \fn  CanProcessor::transmit
+ *
+ *  Hands packets and then everything queued on the bus meanwhile to the
+ *  host. The caller has set Bus::_draining, no lock is held while the
+ *  host runs, so it may confirm packets from inside send_can_packets.
+ *  Packets sent on the bus during the call are queued behind and go
+ *  out from here, which keeps the packet order.
+ *
+ * @param  bus_handle : CanBusHandle
+ * @param  packets : const CanPacket*
+ * @param  count : size_t
+ */
+void CanProcessor::transmit(CanBusHandle bus_handle,const CanPacket* packets,size_t count)
+{
+  ConstantString bus_name = get_bus_name(bus_handle);
+  std::array<CanPacket,CAN_TX_BATCH_SIZE> batch;
+
+  for (;;)
+  {
+    if (count == 1)
+      cback()->send_can_packet(bus_name, packets[0]);
+    else if (count != 0)
+      cback()->send_can_packets(bus_name, packets, count);
+
+    std::lock_guard<RecursiveMutex> l(*bus_mutex(bus_handle));
+    auto bus = _bus_map.at(bus_handle);
+    count = 0;
+    while (!bus->_packet_fifo.empty() && (count < batch.size()))
+    {
+      batch[count++] = bus->_packet_fifo.front();
+      bus->_packet_fifo.pop();
+    }
+
+    if (count == 0)
+    {
+      bus->_draining = false;
+      return;
+    }
+    packets = batch.data();
+  }
+}
+
 /**
  * \fn  CanProcessor::register_pgn_receiver
  *
@@ -565,7 +967,7 @@ bool CanProcessor::send_raw_packet(const CanPacket& packet,const ConstantString&
 void CanProcessor::register_pgn_receiver(uint32_t pgn, const PGNCallback& fn)
 {
   std::lock_guard<RecursiveMutex> l(_mutex);
-  _pgn_receivers.push(PgnReceiver(pgn,fn));
+  _pgn_receivers.push(pgn, fn);
 }
 
 /**
@@ -579,22 +981,133 @@ void CanProcessor::register_updater(const UpdateCallback& fn)
   _updaters.push(fn);
 }
 
+/**
+ * \fn  CanProcessor::create_timer
+ *
+ *  Timer that is armed with schedule_timer and stays allocated until
+ *  release_timer
+ *
+ * @param  fn : const TimerCallback&
+ * @return  CanTimers::Handle, CAN_INVALID_TIMER if none is left
+ */
+CanTimers::Handle CanProcessor::create_timer(const TimerCallback& fn)
+{
+  std::lock_guard<Mutex> l(_timer_mutex);
+  return _timers.create(fn);
+}
+
+/**
+ * \fn  CanProcessor::release_timer
+ *
+ * @param  timer : CanTimers::Handle
+ */
+void CanProcessor::release_timer(CanTimers::Handle timer)
+{
+  std::lock_guard<Mutex> l(_timer_mutex);
+  _timers.release(timer);
+}
+
+/**
+ * \fn  CanProcessor::schedule_timer
+ *
+ * @param  timer : CanTimers::Handle
+ * @param  deadline : uint64_t get_time_tick() value
+ */
+void CanProcessor::schedule_timer(CanTimers::Handle timer,uint64_t deadline)
+{
+  std::lock_guard<Mutex> l(_timer_mutex);
+  _timers.schedule(timer, deadline);
+}
+
+/**
+ * \fn  CanProcessor::add_timer
+ *
+ *  One shot timer, released after fn has been called
+ *
+ * @param  deadline : uint64_t get_time_tick() value
+ * @param  fn : const TimerCallback&
+ * @return  bool
+ */
+bool CanProcessor::add_timer(uint64_t deadline,const TimerCallback& fn)
+{
+  std::lock_guard<Mutex> l(_timer_mutex);
+  CanTimers::Handle timer = _timers.create(fn, true);
+  if (timer == CAN_INVALID_TIMER)
+    return false;
+
+  _timers.schedule(timer, deadline);
+  return true;
+}
+
 /**
  * \fn  CanProcessor::register_bus_callback
  *
- * @param  bus_name : const std::string&
+ * @param  bus_handle : CanBusHandle
  * @param  fn :  BusStatusCallback 
  */
-void CanProcessor::register_bus_callback(const ConstantString& bus_name, const BusStatusCallback& fn)
+void CanProcessor::register_bus_callback(CanBusHandle bus_handle, const BusStatusCallback& fn)
 {
-  std::lock_guard<RecursiveMutex> l(_mutex);
-  auto bus = _bus_map.find_if([bus_name](const Bus& bus)->bool
-      { return bus._bus_name == bus_name; });
+  RecursiveMutex* mutex = bus_mutex(bus_handle);
+  if (mutex == nullptr)
+    return;
+
+  std::lock_guard<RecursiveMutex> l(*mutex);
+  _bus_map.at(bus_handle)->_bus_callbacks.push(fn);
+}
+
+/**
+ * \fn  CanProcessor::notify_bus
+ *
+ *  Calls the bus status callbacks without holding the bus lock,
+ *  a callback returning false stays registered
+ *
+ * @param  handle : CanBusHandle
+ * @param  status : CanBusStatus
+ */
+void CanProcessor::notify_bus(CanBusHandle handle,CanBusStatus status)
+{
+  fixed_list<BusStatusCallback,32> callbacks;
+  {
+    std::lock_guard<RecursiveMutex> l(*bus_mutex(handle));
+    auto bus = _bus_map.at(handle);
+    for (auto& fn : bus->_bus_callbacks)
+      callbacks.push(fn);
+
+    bus->_bus_callbacks.clear();
+  }
+
+  for (auto iter = callbacks.begin(); iter != callbacks.end(); )
+  {
+    if ((*iter) && (*iter)(handle, status))
+      iter = callbacks.erase(iter);
+    else
+      iter++;
+  }
 
-  if (bus == _bus_map.end())
+  if (callbacks.empty())
     return;
-  
-  bus->_bus_callbacks.push(fn);
+
+  std::lock_guard<RecursiveMutex> l(*bus_mutex(handle));
+  auto bus = _bus_map.at(handle);
+  for (auto& fn : callbacks)
+    bus->_bus_callbacks.push(fn);
+}
+
+/**
+ * \fn  CanProcessor::bus_mutex
+ *
+ *  Bus slots are never released, so the lock of a registered bus is
+ *  used without holding _mutex
+ *
+ * @param  bus : CanBusHandle
+ * @return  RecursiveMutex*, nullptr for an unknown bus
+ */
+RecursiveMutex* CanProcessor::bus_mutex(CanBusHandle bus) const
+{
+  if (bus >= _bus_mutex.size())
+    return nullptr;
+
+  return _bus_mutex[bus].get();
 }
 
 /**
@@ -17,6 +17,7 @@
 #include <deque>
 #include <list>
 #include <atomic>
+#include <memory>
 
 #include "can_library.hpp"
 #include "can_utils.hpp"
@@ -27,13 +28,19 @@
 #include "remote_ecu.hpp"
 #include "transport_protocol/can_transport_rxsession.hpp"
 #include "transport_protocol/can_transport_txsession.hpp"
+#include "transport_protocol/can_fast_packet_protocol.hpp"
 #include "transcoders/can_transcoder.hpp"
 
 #include "can_protocol.hpp"
+#include "can_timers.hpp"
 
 namespace brt {
 namespace can {
 
+#define CAN_TX_BATCH_SIZE                   (32)
+
+class CanRxPipeline;
+
 /**
  * \enum CanBusStatus
  *
@@ -53,50 +60,72 @@ enum CanBusStatus
 class CanProcessor : public CanInterface
 {
 friend CanInterface* create_can_interface(CanInterface::Callback*);
+friend class CanRxPipeline;
 private:
   CanProcessor(Callback*);
 
 public:
   typedef std::function<void(uint64_t,CanMessageConfirmation)>        ConfirmationCallback;
-  typedef std::function<void(const CanPacket&,const ConstantString&)> PGNCallback;
+  typedef std::function<void(const CanPacket&,CanBusHandle)>          PGNCallback;
   typedef std::function<bool()>                                       UpdateCallback;
-  typedef std::function<bool(const ConstantString&,CanBusStatus)>     BusStatusCallback;
+  typedef std::function<bool(CanBusHandle,CanBusStatus)>              BusStatusCallback;
+  typedef CanTimers::Callback                                         TimerCallback;
 
   virtual ~CanProcessor();
 
-  virtual void                    update();
+  virtual uint64_t                update();
 
   virtual bool                    register_can_bus(const ConstantString& bus);
+  virtual CanBusHandle            get_bus_handle(const ConstantString& bus) const;
+          ConstantString          get_bus_name(CanBusHandle bus) const;
           CanBusStatus            get_bus_status(const ConstantString& bus) const;
+          CanBusStatus            get_bus_status(CanBusHandle bus) const;
           
           template<size_t _Size>
           size_t                  get_all_buses(fixed_list<ConstantString,_Size>& buses) const
           {
             buses.clear();
             std::lock_guard<RecursiveMutex> l(_mutex);
-            for (auto bus : _bus_map)
+            for (auto& bus : _bus_map)
               buses.push(bus._bus_name);
 
             return buses.size();
           }
+
+          template<size_t _Size>
+          size_t                  get_all_buses(fixed_list<CanBusHandle,_Size>& buses) const
+          {
+            buses.clear();
+            std::lock_guard<RecursiveMutex> l(_mutex);
+            for (auto iter = _bus_map.begin(); iter != _bus_map.end(); ++iter)
+              buses.push(static_cast<CanBusHandle>(_bus_map.index(iter)));
+
+            return buses.size();
+          }
   
   virtual bool                    received_can_packet(const CanPacket& packet,const ConstantString& bus);
+  virtual bool                    received_can_packet(const CanPacket& packet,CanBusHandle bus);
+  virtual size_t                  received_can_packets(const CanPacket* packets,size_t count,const ConstantString& bus);
+  virtual size_t                  received_can_packets(const CanPacket* packets,size_t count,CanBusHandle bus);
 
   virtual bool                    send_can_message(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,
                                                         const std::initializer_list<ConstantString>& buses = std::initializer_list<ConstantString>());
+  virtual bool                    send_can_message(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,
+                                                        CanBusHandle bus);
 
-          void                    message_received(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,const ConstantString& bus_name);
+          void                    message_received(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,CanBusHandle bus);
 
   virtual LocalECUPtr             create_local_ecu(const CanName& name);
-          bool                    activate_local_ecu(const LocalECUPtr&, const ConstantString& bus_name, uint8_t desired_address = BROADCAST_CAN_ADDRESS);
+          bool                    activate_local_ecu(const LocalECUPtr&, CanBusHandle bus, uint8_t desired_address = BROADCAST_CAN_ADDRESS);
 
   virtual RemoteECUPtr            register_abstract_remote_ecu(uint8_t address,const ConstantString& bus);
+          RemoteECUPtr            register_abstract_remote_ecu(uint8_t address,CanBusHandle bus);
 
   virtual bool                    destroy_local_ecu(const LocalECUPtr&);
   virtual bool                    destroy_local_ecu(const CanName& name);
 
-          void                    on_remote_ecu(const RemoteECUPtr& remote,const ConstantString& bus_name)
-          { cback()->on_remote_ecu(remote,bus_name); }
+          void                    on_remote_ecu(const RemoteECUPtr& remote,CanBusHandle bus)
+          { cback()->on_remote_ecu(remote,get_bus_name(bus)); }
   
   virtual void                    can_packet_confirm(uint64_t packet_id,CanMessageConfirmation);
   virtual void                    can_packet_confirm(const CanPacket& packet,CanMessageConfirmation);
@@ -106,14 +135,24 @@ public:
           { device_db().get_remote_ecus(list, buses); }
           
   virtual bool                    request_pgn(uint32_t pgn,const LocalECUPtr& local,const RemoteECUPtr& remote,const RequestCallback& callback);
+  virtual void                    register_fast_packet_pgn(uint32_t pgn);
+  virtual void                    set_rx_buffer_provider(CanBufferProvider* provider) { _rx_buffer_provider.store(provider); }
+          CanBufferProvider*      rx_buffer_provider() const { return _rx_buffer_provider.load(std::memory_order_acquire); }
 
           CanDeviceDatabase&      device_db() { return _device_db; }
           const CanDeviceDatabase& device_db() const { return _device_db; }
 
-          bool                    send_raw_packet(const CanPacket& packet,const ConstantString& bus_name,const ConfirmationCallback& fn = ConfirmationCallback());
+          bool                    send_raw_packet(const CanPacket& packet,CanBusHandle bus,const ConfirmationCallback& fn = ConfirmationCallback());
+          bool                    send_raw_packets(const CanPacket* packets,size_t count,CanBusHandle bus,const ConfirmationCallback& fn = ConfirmationCallback(),
+                                                bool confirm_each = false);
           void                    register_pgn_receiver(uint32_t pgn, const PGNCallback& fn);
           void                    register_updater(const UpdateCallback& fn);
-          void                    register_bus_callback(const ConstantString& bus_name,const BusStatusCallback& fn);
+          void                    register_bus_callback(CanBusHandle bus,const BusStatusCallback& fn);
+
+          CanTimers::Handle       create_timer(const TimerCallback& fn);
+          void                    release_timer(CanTimers::Handle timer);
+          void                    schedule_timer(CanTimers::Handle timer,uint64_t deadline);
+          bool                    add_timer(uint64_t deadline,const TimerCallback& fn);
 
           uint64_t                get_time_tick() const;
           uint32_t                create_mutex() { return cback()->create_mutex(); }
@@ -124,7 +163,37 @@ public:
 
 
 private:
-          void                    on_request(const CanPacket&,const ConstantString&);
+  /**
+   * \class EcuMemo
+   *
+   *  Small direct mapped cache of device DB address lookups for one burst
+   *  of received packets on one bus. It is flushed whenever the device DB
+   *  generation changes, e.g. after an Address Claimed packet.
+   */
+  class EcuMemo
+  {
+  public:
+    EcuMemo(const CanDeviceDatabase& db, CanBusHandle bus);
+
+          CanECUPtr               get(uint8_t address);
+
+  private:
+    static  constexpr size_t      _size = 8;
+    static  constexpr uint16_t    _empty = 0x100;
+
+    const CanDeviceDatabase&      _db;
+    CanBusHandle                  _bus;
+    uint32_t                      _generation;
+    std::array<uint16_t,_size>    _address;
+    std::array<CanECUPtr,_size>   _ecu;
+  };
+
+          void                    on_request(const CanPacket&,CanBusHandle);
+          void                    notify_bus(CanBusHandle handle,CanBusStatus status);
+          RecursiveMutex*         bus_mutex(CanBusHandle bus) const;
+          void                    transmit(CanBusHandle bus,const CanPacket* packets,size_t count);
+          bool                    process_can_packet(const CanPacket& packet,CanBusHandle bus,EcuMemo& memo);
+          size_t                  process_can_packets(const CanPacket* packets,size_t count,CanBusHandle bus);
 private:
   
   /**
@@ -140,10 +209,18 @@ private:
     virtual ~SimpleTransport() {}
 
     virtual bool                    send_message(const CanMessagePtr& message,const LocalECUPtr& local,
-                                              const RemoteECUPtr& remote, const ConstantString& bus_name);
+                                              const RemoteECUPtr& remote, CanBusHandle bus);
   };
 
+  // Guards the bus list, updaters and requested PGNs. Bus state has a
+  // lock of its own and confirmations sit behind _confirm_mutex, so
+  // traffic on different buses doesn't contend. No lock is held while
+  // user callbacks run.
   mutable RecursiveMutex         _mutex;
+  // Indexed by CanBusHandle, guards Bus::_status, _draining, _packet_fifo
+  // and _bus_callbacks. Never held while the host transmits. Created
+  // with the bus and never released.
+  std::array<std::unique_ptr<RecursiveMutex>,MAX_CAN_BUSES> _bus_mutex;
   CanDeviceDatabase               _device_db;
   std::atomic_uint_fast64_t       _remote_name_counter;
 
@@ -158,18 +235,35 @@ private:
     uint64_t                        _time_tag;
     uint64_t                        _initial_packet_id;
 
+    // Set while a thread hands packets to the host outside the bus
+    // lock, others queue behind it in _packet_fifo
+    bool                            _draining;
     fifo<CanPacket>                 _packet_fifo;
     fixed_list<BusStatusCallback,32> _bus_callbacks;
   };
 
-  typedef fixed_list<Bus,32>      BusMap;
+  // Indexed by CanBusHandle, slots are never released
+  typedef fixed_list<Bus,MAX_CAN_BUSES> BusMap;
   BusMap                          _bus_map;
 
-  typedef std::pair<uint32_t,PGNCallback> PgnReceiver;
-  fixed_list<PgnReceiver,32>       _pgn_receivers;
+  // Read on every received packet without holding _mutex
+  pgn_table<PGNCallback>          _pgn_receivers;
+
+  // Set when LibraryConfig::_rx_worker_threads is not 0 and the library
+  // is built with CAN_LIBRARY_RX_PIPELINE
+  CanRxPipeline*                  _rx_pipeline;
+  std::atomic<CanBufferProvider*> _rx_buffer_provider;
 
   fixed_list<UpdateCallback,32>   _updaters;
+
+  // Deadlines are get_time_tick() values, _timer_mutex is never held
+  // while a timer callback runs
+  Mutex                           _timer_mutex;
+  CanTimers                       _timers;
+
   fixed_list<CanProtocolPtr,32>   _transport_stack;
+  // Owned by _transport_stack
+  FastPacketProtocol*             _fast_packet;
 
   // Real time structures
   /**
@@ -187,6 +281,8 @@ private:
     uint64_t                      _packet_id;
     ConfirmationCallback          _callback;
   };
+  // Leaf lock, may be taken with a bus lock held
+  Mutex                           _confirm_mutex;
   fixed_list<PacketConfirmation>  _confirm_callbacks;
 
   /**
@@ -31,7 +31,7 @@ public:
   virtual ~CanProtocol();
 
   virtual bool                    send_message(const CanMessagePtr& message,const LocalECUPtr& local,
-                                                          const RemoteECUPtr& remote, const ConstantString& buses) = 0;
+                                                          const RemoteECUPtr& remote, CanBusHandle bus) = 0;
 
           CanProcessor*           processor() { return _processor; }
 
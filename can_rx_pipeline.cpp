@@ -0,0 +1,188 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 11/16/2020 11:59:45
+ * File : can_rx_pipeline.cpp
+ *
+ */
+    
+#include "can_rx_pipeline.hpp"  
+#include "can_processor.hpp"  
+
+namespace brt {
+namespace can {
+
+/**
+ * \fn  constructor CanRxPipeline::CanRxPipeline
+ *
+ * @param  processor : CanProcessor* 
+ * @param  workers : size_t 
+ */
+CanRxPipeline::CanRxPipeline(CanProcessor* processor, size_t workers)
+: _processor(processor)
+, _num_workers(std::max(workers, static_cast<size_t>(1)))
+, _workers(new Worker[_num_workers])
+, _stop(false)
+{
+  for (auto& queue : _queues)
+    queue.store(nullptr);
+
+  for (size_t index = 0; index < _num_workers; index++)
+    _workers[index]._thread = std::thread(&CanRxPipeline::run, this, index);
+}
+
+/**
+ * \fn  destructor CanRxPipeline::~CanRxPipeline
+ *
+ */
+CanRxPipeline::~CanRxPipeline()
+{
+  _stop.store(true);
+  for (size_t index = 0; index < _num_workers; index++)
+  {
+    {
+      std::lock_guard<std::mutex> l(_workers[index]._mutex);
+      _workers[index]._signaled.store(true);
+    }
+    _workers[index]._cv.notify_one();
+    _workers[index]._thread.join();
+  }
+
+  delete[] _workers;
+  for (auto& queue : _queues)
+    delete queue.load();
+}
+
+/**
+ * \fn  CanRxPipeline::add_bus
+ *
+ * @param  bus : CanBusHandle
+ */
+void CanRxPipeline::add_bus(CanBusHandle bus)
+{
+  if ((bus >= MAX_CAN_BUSES) || (_queues[bus].load() != nullptr))
+    return;
+
+  _queues[bus].store(new IngressQueue(), std::memory_order_release);
+}
+
+/**
+ * \fn  CanRxPipeline::enqueue
+ *
+ *  Called from the host driver threads. Never blocks, returns false if
+ *  the bus is unknown or its ingress ring is full
+ *
+ * @param  packet : const CanPacket&
+ * @param  bus : CanBusHandle
+ * @return  bool
+ */
+bool CanRxPipeline::enqueue(const CanPacket& packet, CanBusHandle bus)
+{
+  return (enqueue(&packet, 1, bus) == 1);
+}
+
+/**
+ * \fn  CanRxPipeline::enqueue
+ *
+ *  Burst version, the worker is signaled once for the whole burst
+ *
+ * @param  packets : const CanPacket*
+ * @param  count : size_t
+ * @param  bus : CanBusHandle
+ * @return  size_t number of queued packets
+ */
+size_t CanRxPipeline::enqueue(const CanPacket* packets, size_t count, CanBusHandle bus)
+{
+  if (bus >= MAX_CAN_BUSES)
+    return 0;
+
+  IngressQueue* queue = _queues[bus].load(std::memory_order_acquire);
+  if (queue == nullptr)
+    return 0;
+
+  size_t result = 0, pushed;
+  while ((result < count) && ((pushed = queue->push(packets + result, count - result)) != 0))
+    result += pushed;
+
+  if (result != 0)
+    signal(bus);
+
+  return result;
+}
+
+/**
+ * \fn  CanRxPipeline::signal
+ *
+ * @param  bus : CanBusHandle
+ */
+void CanRxPipeline::signal(CanBusHandle bus)
+{
+  Worker& wrk = worker(bus);
+  if (!wrk._signaled.exchange(true))
+  {
+    std::lock_guard<std::mutex> l(wrk._mutex);
+    wrk._cv.notify_one();
+  }
+}
+
+/**
+ * \fn  CanRxPipeline::drain
+ *
+ *  One batch per bus per pass, so a saturated bus cannot starve the
+ *  other buses served by the same worker
+ *
+ * @param  index : size_t 
+ * @return  size_t number of processed packets
+ */
+size_t CanRxPipeline::drain(size_t index)
+{
+  size_t result = 0, processed;
+  CanPacket batch[CAN_RX_BATCH_SIZE];
+
+  do
+  {
+    processed = 0;
+    for (size_t bus = index; bus < MAX_CAN_BUSES; bus += _num_workers)
+    {
+      IngressQueue* queue = _queues[bus].load(std::memory_order_acquire);
+      if (queue == nullptr)
+        continue;
+
+      size_t count = queue->pop(batch, CAN_RX_BATCH_SIZE);
+      if (count != 0)
+      {
+        _processor->process_can_packets(batch, count, static_cast<CanBusHandle>(bus));
+        processed += count;
+      }
+    }
+    result += processed;
+  } while (processed != 0);
+
+  return result;
+}
+
+/**
+ * \fn  CanRxPipeline::run
+ *
+ *  Worker thread. The signal flag is cleared before draining, so a
+ *  packet pushed during the drain always wakes the worker again
+ *
+ * @param  index : size_t 
+ */
+void CanRxPipeline::run(size_t index)
+{
+  Worker& wrk = _workers[index];
+  while (!_stop.load())
+  {
+    wrk._signaled.store(false);
+    if (drain(index) != 0)
+      continue;
+
+    std::unique_lock<std::mutex> l(wrk._mutex);
+    wrk._cv.wait(l, [this, &wrk]() { return wrk._signaled.load() || _stop.load(); });
+  }
+}
+
+} // can
+} // brt
+
@@ -0,0 +1,82 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 11/16/2020 11:59:45
+ * File : can_rx_pipeline.hpp
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "can_message.hpp"
+#include "can_utils.hpp"
+
+namespace brt {
+namespace can {
+
+#define CAN_RX_QUEUE_SIZE                   (1024)
+#define CAN_RX_BATCH_SIZE                   (32)
+
+class CanProcessor;
+/**
+ * \class CanRxPipeline
+ *
+ *  Pipelined receive mode. received_can_packet only pushes the packet
+ *  into the lock-free ingress ring of its bus and returns. Library owned
+ *  worker threads drain the rings in batches and run the regular receive
+ *  path. Bus handle % worker count selects the worker, so packets of one
+ *  bus are always processed in order by the same thread.
+ */
+class CanRxPipeline
+{
+public:
+  CanRxPipeline(CanProcessor* processor, size_t workers);
+  ~CanRxPipeline();
+
+          void                    add_bus(CanBusHandle bus);
+          bool                    enqueue(const CanPacket& packet, CanBusHandle bus);
+          size_t                  enqueue(const CanPacket* packets, size_t count, CanBusHandle bus);
+
+private:
+  typedef mpsc_fifo<CanPacket,CAN_RX_QUEUE_SIZE>  IngressQueue;
+
+  /**
+   * \struct Worker
+   *
+   */
+  struct Worker
+  {
+    Worker() : _signaled(false) {}
+
+    std::thread                   _thread;
+    std::mutex                    _mutex;
+    std::condition_variable       _cv;
+    std::atomic_bool              _signaled;
+  };
+
+          void                    run(size_t index);
+          size_t                  drain(size_t index);
+          void                    signal(CanBusHandle bus);
+          Worker&                 worker(CanBusHandle bus) { return _workers[bus % _num_workers]; }
+
+private:
+  CanProcessor*                   _processor;
+  size_t                          _num_workers;
+  Worker*                         _workers;
+  std::atomic_bool                _stop;
+
+  // Indexed by CanBusHandle, queues are created once and never released
+  std::array<std::atomic<IngressQueue*>,MAX_CAN_BUSES> _queues;
+};
+
+} // can
+} // brt
+
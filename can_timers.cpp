@@ -0,0 +1,216 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026 14:2:18
+ * File : can_timers.cpp
+ *
+ */
+
+#include "can_timers.hpp"
+
+#include <utility>
+
+namespace brt {
+namespace can {
+
+/**
+ * \fn  constructor CanTimers::CanTimers
+ *
+ */
+CanTimers::CanTimers()
+: _heap_size(0)
+, _free_size(0)
+{
+  for (size_t index = _timers.size(); index-- > 0; )
+    _free[_free_size++] = static_cast<Handle>(index);
+}
+
+/**
+ * \fn  CanTimers::create
+ *
+ *  One shot timers are released once they fire
+ *
+ * @param  fn : const Callback&
+ * @param  one_shot : bool
+ * @return  Handle, CAN_INVALID_TIMER if all timers are in use
+ */
+CanTimers::Handle CanTimers::create(const Callback& fn, bool one_shot /*= false*/)
+{
+  if (_free_size == 0)
+    return CAN_INVALID_TIMER;
+
+  Handle timer = _free[--_free_size];
+  _timers[timer]._callback = fn;
+  _timers[timer]._one_shot = one_shot;
+  _timers[timer]._used = true;
+  return timer;
+}
+
+/**
+ * \fn  CanTimers::release
+ *
+ * @param  timer : Handle
+ */
+void CanTimers::release(Handle timer)
+{
+  if ((timer >= _timers.size()) || !_timers[timer]._used)
+    return;
+
+  cancel(timer);
+  _timers[timer] = Timer();
+  _free[_free_size++] = timer;
+}
+
+/**
+ * \fn  CanTimers::schedule
+ *
+ *  Arms the timer, an armed timer moves to the new deadline
+ *
+ * @param  timer : Handle
+ * @param  deadline : uint64_t time tick
+ */
+void CanTimers::schedule(Handle timer, uint64_t deadline)
+{
+  if ((timer >= _timers.size()) || !_timers[timer]._used)
+    return;
+
+  Timer& tm = _timers[timer];
+  if (tm._position == _not_scheduled)
+  {
+    tm._deadline = deadline;
+    tm._position = static_cast<uint32_t>(_heap_size);
+    _heap[_heap_size++] = timer;
+    sift_up(tm._position);
+    return;
+  }
+
+  uint64_t previous = tm._deadline;
+  tm._deadline = deadline;
+  if (deadline < previous)
+    sift_up(tm._position);
+  else
+    sift_down(tm._position);
+}
+
+/**
+ * \fn  CanTimers::cancel
+ *
+ * @param  timer : Handle
+ */
+void CanTimers::cancel(Handle timer)
+{
+  if ((timer >= _timers.size()) || (_timers[timer]._position == _not_scheduled))
+    return;
+
+  size_t pos = _timers[timer]._position;
+  swap(pos, --_heap_size);
+  _timers[timer]._position = _not_scheduled;
+  _timers[timer]._deadline = CAN_NO_DEADLINE;
+
+  if (pos < _heap_size)
+  {
+    sift_up(pos);
+    sift_down(pos);
+  }
+}
+
+/**
+ * \fn  CanTimers::next_deadline
+ *
+ * @return  uint64_t, CAN_NO_DEADLINE if no timer is armed
+ */
+uint64_t CanTimers::next_deadline() const
+{
+  return (_heap_size == 0) ? CAN_NO_DEADLINE : _timers[_heap[0]]._deadline;
+}
+
+/**
+ * \fn  CanTimers::pop_expired
+ *
+ *  Disarms the earliest timer if it is due and hands out its callback,
+ *  which the caller runs without holding its lock
+ *
+ * @param  time_tick : uint64_t
+ * @param  fn : Callback&
+ * @return  bool
+ */
+bool CanTimers::pop_expired(uint64_t time_tick, Callback& fn)
+{
+  if ((_heap_size == 0) || (_timers[_heap[0]]._deadline > time_tick))
+    return false;
+
+  Handle timer = _heap[0];
+  if (_timers[timer]._one_shot)
+  {
+    fn = std::move(_timers[timer]._callback);
+    release(timer);
+  }
+  else
+  {
+    fn = _timers[timer]._callback;
+    cancel(timer);
+  }
+
+  return true;
+}
+
+/**
+ * \fn  CanTimers::swap
+ *
+ * @param  a : size_t
+ * @param  b : size_t
+ */
+void CanTimers::swap(size_t a, size_t b)
+{
+  std::swap(_heap[a], _heap[b]);
+  _timers[_heap[a]]._position = static_cast<uint32_t>(a);
+  _timers[_heap[b]]._position = static_cast<uint32_t>(b);
+}
+
+/**
+ * \fn  CanTimers::sift_up
+ *
+ * @param  pos : size_t
+ */
+void CanTimers::sift_up(size_t pos)
+{
+  while (pos > 0)
+  {
+    size_t parent = (pos - 1) / 2;
+    if (!less(pos, parent))
+      break;
+
+    swap(pos, parent);
+    pos = parent;
+  }
+}
+
+/**
+ * \fn  CanTimers::sift_down
+ *
+ * @param  pos : size_t
+ */
+void CanTimers::sift_down(size_t pos)
+{
+  for (;;)
+  {
+    size_t smallest = pos;
+    size_t left = pos * 2 + 1;
+    size_t right = left + 1;
+
+    if ((left < _heap_size) && less(left, smallest))
+      smallest = left;
+
+    if ((right < _heap_size) && less(right, smallest))
+      smallest = right;
+
+    if (smallest == pos)
+      break;
+
+    swap(pos, smallest);
+    pos = smallest;
+  }
+}
+
+} // can
+} // brt
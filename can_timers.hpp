@@ -0,0 +1,80 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026 14:2:18
+ * File : can_timers.hpp
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <functional>
+
+namespace brt {
+namespace can {
+
+#define CAN_MAX_TIMERS                      (1024)
+#define CAN_INVALID_TIMER                   (0xFFFFFFFF)
+#define CAN_NO_DEADLINE                     (0xFFFFFFFFFFFFFFFFULL)
+
+/**
+ * \class CanTimers
+ *
+ *  Binary min-heap of timer deadlines. Every timer knows its heap
+ *  position, so re-arming or cancelling a timer moves it in place and
+ *  no stale entries pile up. Not synchronized, the owner locks.
+ */
+class CanTimers
+{
+public:
+  typedef std::function<void()>   Callback;
+  typedef uint32_t                Handle;
+
+  CanTimers();
+
+          Handle                  create(const Callback& fn, bool one_shot = false);
+          void                    release(Handle timer);
+          void                    schedule(Handle timer, uint64_t deadline);
+          void                    cancel(Handle timer);
+
+          uint64_t                next_deadline() const;
+          bool                    pop_expired(uint64_t time_tick, Callback& fn);
+
+private:
+          bool                    less(size_t a, size_t b) const
+          { return _timers[_heap[a]]._deadline < _timers[_heap[b]]._deadline; }
+
+          void                    swap(size_t a, size_t b);
+          void                    sift_up(size_t pos);
+          void                    sift_down(size_t pos);
+
+private:
+  static  constexpr uint32_t      _not_scheduled = 0xFFFFFFFF;
+
+  /**
+   * \struct Timer
+   *
+   */
+  struct Timer
+  {
+    Timer() : _deadline(CAN_NO_DEADLINE), _position(_not_scheduled), _one_shot(false), _used(false) {}
+
+    uint64_t                      _deadline;
+    Callback                      _callback;
+    uint32_t                      _position;  // Index into _heap
+    bool                          _one_shot;
+    bool                          _used;
+  };
+
+  std::array<Timer,CAN_MAX_TIMERS>    _timers;
+  std::array<Handle,CAN_MAX_TIMERS>   _heap;
+  size_t                              _heap_size;
+  std::array<Handle,CAN_MAX_TIMERS>   _free;
+  size_t                              _free_size;
+};
+
+} // can
+} // brt
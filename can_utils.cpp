@@ -9,18 +9,64 @@
 #include "can_utils.hpp"
 #include "can_processor.hpp"
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace brt {
 namespace can {
 
+/**
+ * \fn  park
+ *
+ *  Sleeps while word still holds value, spurious returns are fine
+ *
+ * @param  word : std::atomic_uint32_t&
+ * @param  value : uint32_t
+ */
+static inline void park(std::atomic_uint32_t& word,uint32_t value)
+{
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else
+  // No portable sleep primitive without the std threading runtime,
+  // keep spinning
+  if (word.load(std::memory_order_relaxed) == value)
+    cpu_relax();
+#endif
+}
+
+/**
+ * \fn  unpark
+ *
+ *  Wakes one thread parked on word
+ *
+ * @param  word : std::atomic_uint32_t&
+ */
+static inline void unpark(std::atomic_uint32_t& word)
+{
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
 /**
  * \fn  constructor Mutex::Mutex
  *
  * @param  processor : CanProcessor* 
  */
 Mutex::Mutex(CanProcessor* processor)
-: _processor(processor)
+: _mutex_id(0)
+, _processor(processor)
+, _native(can_library_config()._lock_implementation == eNativeLocks)
+, _state(0)
 {
-  _mutex_id = _processor->create_mutex();
+  if (!_native)
+    _mutex_id = _processor->create_mutex();
 }
 
 /**
@@ -29,7 +75,8 @@ Mutex::Mutex(CanProcessor* processor)
  */
 Mutex::~Mutex()
 {
-  _processor->delete_mutex(_mutex_id);
+  if (!_native)
+    _processor->delete_mutex(_mutex_id);
 }
 
 /**
@@ -38,7 +85,10 @@ Mutex::~Mutex()
  */
 void Mutex::lock()
 {
-  _processor->lock_mutex(_mutex_id);
+  if (_native)
+    native_lock();
+  else
+    _processor->lock_mutex(_mutex_id);
 }
 
 /**
@@ -47,7 +97,52 @@ void Mutex::lock()
  */
 void Mutex::unlock()
 {
-  _processor->unlock_mutex(_mutex_id);
+  if (_native)
+    native_unlock();
+  else
+    _processor->unlock_mutex(_mutex_id);
+}
+
+/**
+ * \fn  Mutex::native_lock
+ *
+ *  Spins NATIVE_MUTEX_SPIN_COUNT times on a held lock, then parks
+ *  the thread until native_unlock wakes it
+ */
+void Mutex::native_lock()
+{
+  uint32_t state = 0;
+  if (_state.compare_exchange_strong(state, 1, std::memory_order_acquire))
+    return;
+
+  for (int spin = 0; spin < NATIVE_MUTEX_SPIN_COUNT; spin++)
+  {
+    cpu_relax();
+    state = 0;
+    if ((_state.load(std::memory_order_relaxed) == 0) &&
+        _state.compare_exchange_strong(state, 1, std::memory_order_acquire))
+    {
+      return;
+    }
+  }
+
+  // The state stays 2 while anybody may sleep on it
+  state = _state.exchange(2, std::memory_order_acquire);
+  while (state != 0)
+  {
+    park(_state, 2);
+    state = _state.exchange(2, std::memory_order_acquire);
+  }
+}
+
+/**
+ * \fn  Mutex::native_unlock
+ *
+ */
+void Mutex::native_unlock()
+{
+  if (_state.exchange(0, std::memory_order_release) == 2)
+    unpark(_state);
 }
 
 /**
@@ -69,14 +164,15 @@ RecursiveMutex::RecursiveMutex(CanProcessor* processor)
  */
 void RecursiveMutex::lock()
 {
-  if (_thread_id.load() == processor()->get_current_thread_id())
+  uint32_t id = thread_id();
+  if (_thread_id.load() == id)
   {
     _lock_counter++;    
   }
   else
   {
     Mutex::lock();
-    _thread_id.store(processor()->get_current_thread_id());
+    _thread_id.store(id);
     _lock_counter = 1;
   }
 }
@@ -99,6 +195,24 @@ void RecursiveMutex::unlock()
   }
 }
 
+/**
+ * \fn  RecursiveMutex::thread_id
+ *
+ *  Native locks number the threads themselves instead of asking
+ *  the host
+ *
+ * @return  uint32_t
+ */
+uint32_t RecursiveMutex::thread_id()
+{
+  if (!is_native())
+    return processor()->get_current_thread_id();
+
+  static std::atomic_uint32_t next_id(0);
+  static thread_local uint32_t id = next_id++;
+  return id;
+}
+
 
 const char ConstantString::_empty_string[3] = "";
 
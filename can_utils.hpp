@@ -13,39 +13,114 @@
 #include <array>
 #include <stdexcept>
 #include <algorithm>
-#include <typeinfo>
 #include <vector>
+#include <new>
 
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace brt {
 namespace can {
 
+#define MAX_CAN_BUSES                       (32)
+
+/**
+ * Bus handle is the index of the bus slot assigned by register_can_bus,
+ * resolved through get_bus_handle
+ */
+typedef uint32_t CanBusHandle;
+#define INVALID_CAN_BUS_HANDLE              (static_cast<CanBusHandle>(-1))
+
+#define MAX_MESSAGE_SIZE_CLASSES            (8)
+#define CAN_CACHE_LINE_SIZE                 (64)
+#define NATIVE_MUTEX_SPIN_COUNT             (100)
+
+/**
+ * \enum LockImplementation
+ *
+ */
+enum LockImplementation
+{
+  eHostLocks,             // CanInterface::Callback mutexes, e.g. for RTOS ports
+  eNativeLocks            // Library owned spin then park locks (futex on Linux)
+};
+
 /**
  * \struct LibraryConfig
  *
  */
 struct LibraryConfig
 {
+  /**
+   * \struct MessageSizeClass
+   *
+   *  One CanMessage pool. Messages take a slot from the smallest class
+   *  whose _payload_size fits them. Entries with zero _payload_size are
+   *  unused. Messages above the largest class come from the heap.
+   */
+  struct MessageSizeClass
+  {
+    size_t                        _payload_size;
+    size_t                        _pool_size;
+  };
+
   LibraryConfig() 
   // Default Values
   : _local_ecu_pool_size(1024)
   , _remote_ecu_pool_size(1024)
-  , _big_messages_pool_size(1024)
-  , _small_messages_pool_size(1024)
+  , _message_size_classes{{
+      { 8,     1024 },          // Single frame
+      { 64,    256  },          // Short TP messages (DM1, proprietary)
+      { 256,   64   },
+      { 255*7, 32   },          // Largest TP message
+      { 65536, 0    },          // ETP, heap only unless a pool is configured
+    }}
   , _tx_tpsessions_pool_size(32)
   , _rx_tpsessions_pool_size(32)
   , _transcoder_pool_size(32)
+  , _rx_heap_message_limit(65536)
+  , _rx_worker_threads(0)
+  , _adaptive_cts_window(false)
+  , _tp_tx_window(1)
+  , _lock_implementation(eHostLocks)
   {  }
 
   size_t                          _local_ecu_pool_size;
   size_t                          _remote_ecu_pool_size;
-  size_t                          _big_messages_pool_size;
-  size_t                          _small_messages_pool_size;
+  std::array<MessageSizeClass,MAX_MESSAGE_SIZE_CLASSES>
+                                  _message_size_classes;
   size_t                          _tx_tpsessions_pool_size;
   size_t                          _rx_tpsessions_pool_size;
 
   size_t                          _transcoder_pool_size;
+
+  // Largest transport message reassembled on the heap. Bigger messages
+  // announced by a peer need a buffer from the CanBufferProvider and are
+  // aborted with AbortScarseResources otherwise.
+  size_t                          _rx_heap_message_limit;
+
+  // Number of library owned receive threads. 0 processes received packets
+  // directly on the caller's thread. Ignored unless the library is built
+  // with CAN_LIBRARY_RX_PIPELINE.
+  size_t                          _rx_worker_threads;
+
+  // RTS/CTS receivers start with a small CTS window and grow or shrink
+  // it with the observed DT throughput and losses, instead of always
+  // granting the sender's maximum
+  bool                            _adaptive_cts_window;
+
+  // TP.DT packets a TX session hands to the driver before the first of
+  // them is confirmed. 1 waits for every confirmation.
+  size_t                          _tp_tx_window;
+
+  // Locks taken by the library. eNativeLocks never calls lock_mutex or
+  // get_current_thread_id of the host.
+  LockImplementation              _lock_implementation;
 };
 
 /**
@@ -142,6 +217,427 @@ private:
   size_t                          _write;
 };
 
+/**
+ * \class spsc_fifo
+ *
+ *  Lock-free ring buffer for one producer thread and one consumer thread.
+ *  Indices grow without wrapping and are masked on access. Each side
+ *  keeps a cached copy of the other side's index on its own cache line,
+ *  so the shared index is only reloaded when the ring looks full or empty.
+ */
+template<typename _Type,size_t _Size = 1024>
+class spsc_fifo
+{
+  static_assert((_Size != 0) && ((_Size & (_Size - 1)) == 0), "spsc_fifo size must be a power of two");
+  static  constexpr size_t        _mask = _Size - 1;
+
+public:
+  typedef _Type& reference;
+  typedef const _Type& const_reference;
+
+  spsc_fifo() : _write(0), _read_cache(0), _read(0), _write_cache(0), _buffer() {}
+  ~spsc_fifo() {}
+
+  spsc_fifo(const spsc_fifo&) = delete;
+  spsc_fifo& operator=(const spsc_fifo&) = delete;
+
+  bool empty() const
+  {
+    return (_read.load(std::memory_order_acquire) == _write.load(std::memory_order_acquire));
+  }
+
+  size_t size() const
+  {
+    size_t read = _read.load(std::memory_order_acquire);
+    return _write.load(std::memory_order_acquire) - read;
+  }
+
+  /**
+   * \fn  push
+   *
+   *  Producer side. Returns false if the ring is full
+   */
+  bool push(const_reference v)
+  {
+    return (push(&v, 1) == 1);
+  }
+
+  /**
+   * \fn  push
+   *
+   *  Producer side. Pushes up to count items and publishes them with a
+   *  single index store.
+   *
+   * @param  items : const _Type* 
+   * @param  count : size_t 
+   * @return  size_t number of items pushed
+   */
+  size_t push(const _Type* items, size_t count)
+  {
+    size_t write = _write.load(std::memory_order_relaxed);
+    if (_Size - (write - _read_cache) < count)
+      _read_cache = _read.load(std::memory_order_acquire);
+
+    count = std::min(count, _Size - (write - _read_cache));
+    for (size_t index = 0; index < count; index++)
+      _buffer[(write + index) & _mask] = items[index];
+
+    if (count != 0)
+      _write.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * \fn  pop
+   *
+   *  Consumer side. Returns false if the ring is empty
+   */
+  bool pop(reference v)
+  {
+    return (pop(&v, 1) == 1);
+  }
+
+  /**
+   * \fn  pop
+   *
+   *  Consumer side. Pops up to count items and releases the slots with a
+   *  single index store.
+   *
+   * @param  items : _Type* 
+   * @param  count : size_t 
+   * @return  size_t number of items popped
+   */
+  size_t pop(_Type* items, size_t count)
+  {
+    size_t read = _read.load(std::memory_order_relaxed);
+    if ((_write_cache - read) < count)
+      _write_cache = _write.load(std::memory_order_acquire);
+
+    count = std::min(count, _write_cache - read);
+    for (size_t index = 0; index < count; index++)
+    {
+      _Type& slot = _buffer[(read + index) & _mask];
+      items[index] = std::move(slot);
+      slot = _Type();
+    }
+
+    if (count != 0)
+      _read.store(read + count, std::memory_order_release);
+    return count;
+  }
+
+private:
+  alignas(CAN_CACHE_LINE_SIZE) std::atomic_size_t _write;
+  size_t                          _read_cache;
+
+  alignas(CAN_CACHE_LINE_SIZE) std::atomic_size_t _read;
+  size_t                          _write_cache;
+
+  alignas(CAN_CACHE_LINE_SIZE) std::array<_Type,_Size> _buffer;
+};
+
+/**
+ * \class mpsc_fifo
+ *
+ *  Lock-free bounded ring buffer for many producer threads and one
+ *  consumer thread. Every cell carries a sequence number (Vyukov queue).
+ *  A cell is free for position p when its sequence is p and holds data
+ *  when its sequence is p + 1. Producers reserve positions with a CAS on
+ *  the write index. The consumer owns the read index and needs no atomics
+ *  on it.
+ */
+template<typename _Type,size_t _Size = 1024>
+class mpsc_fifo
+{
+  static_assert((_Size != 0) && ((_Size & (_Size - 1)) == 0), "mpsc_fifo size must be a power of two");
+  static  constexpr size_t        _mask = _Size - 1;
+
+  struct cell
+  {
+    std::atomic_size_t            _sequence;
+    _Type                         _value;
+  };
+
+  static  intptr_t                diff(size_t a, size_t b) { return static_cast<intptr_t>(a - b); }
+
+public:
+  typedef _Type& reference;
+  typedef const _Type& const_reference;
+
+  mpsc_fifo() : _cells(), _write(0), _read(0)
+  {
+    for (size_t index = 0; index < _Size; index++)
+      _cells[index]._sequence.store(index, std::memory_order_relaxed);
+  }
+  ~mpsc_fifo() {}
+
+  mpsc_fifo(const mpsc_fifo&) = delete;
+  mpsc_fifo& operator=(const mpsc_fifo&) = delete;
+
+  /**
+   * \fn  empty
+   *
+   *  Consumer side
+   */
+  bool empty() const
+  {
+    return (_cells[_read & _mask]._sequence.load(std::memory_order_acquire) != _read + 1);
+  }
+
+  /**
+   * \fn  push
+   *
+   *  Producer side. Returns false if the ring is full
+   */
+  bool push(const_reference v)
+  {
+    return (push(&v, 1) == 1);
+  }
+
+  /**
+   * \fn  push
+   *
+   *  Producer side. Reserves a contiguous range of up to count positions
+   *  with one CAS. The consumer frees cells in order, so if the last cell
+   *  of the range is free then every cell before it is free too.
+   *
+   * @param  items : const _Type* 
+   * @param  count : size_t 
+   * @return  size_t number of items pushed
+   */
+  size_t push(const _Type* items, size_t count)
+  {
+    count = std::min(count, _Size);
+    if (count == 0)
+      return 0;
+
+    size_t pos = _write.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      intptr_t dif = diff(_cells[pos & _mask]._sequence.load(std::memory_order_acquire), pos);
+      if (dif < 0)
+        return 0;
+
+      if (dif > 0)
+      {
+        pos = _write.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      size_t range = count;
+      while ((range > 1) && 
+            (_cells[(pos + range - 1) & _mask]._sequence.load(std::memory_order_acquire) != (pos + range - 1)))
+      {
+        range--;
+      }
+
+      if (_write.compare_exchange_weak(pos, pos + range, std::memory_order_relaxed))
+      {
+        for (size_t index = 0; index < range; index++)
+        {
+          cell& cl = _cells[(pos + index) & _mask];
+          cl._value = items[index];
+          cl._sequence.store(pos + index + 1, std::memory_order_release);
+        }
+        return range;
+      }
+    }
+  }
+
+  /**
+   * \fn  pop
+   *
+   *  Consumer side. Returns false if the ring is empty or the next
+   *  reserved cell is not published yet
+   */
+  bool pop(reference v)
+  {
+    return (pop(&v, 1) == 1);
+  }
+
+  /**
+   * \fn  pop
+   *
+   *  Consumer side. Pops up to count published items in order
+   *
+   * @param  items : _Type* 
+   * @param  count : size_t 
+   * @return  size_t number of items popped
+   */
+  size_t pop(_Type* items, size_t count)
+  {
+    size_t popped = 0;
+    while (popped < count)
+    {
+      cell& cl = _cells[_read & _mask];
+      if (cl._sequence.load(std::memory_order_acquire) != (_read + 1))
+        break;
+
+      items[popped++] = std::move(cl._value);
+      cl._value = _Type();
+      cl._sequence.store(_read + _Size, std::memory_order_release);
+      _read++;
+    }
+    return popped;
+  }
+
+private:
+  alignas(CAN_CACHE_LINE_SIZE) std::array<cell,_Size> _cells;
+  alignas(CAN_CACHE_LINE_SIZE) std::atomic_size_t _write;
+  alignas(CAN_CACHE_LINE_SIZE) size_t _read;
+};
+
+/**
+ * \class bit_map
+ *
+ *  Fixed size bitmap with word at a time range queries. The 256 bit
+ *  map checks a whole range with one AVX2 or two NEON operations where
+ *  the target has them.
+ */
+template<size_t _Bits>
+class bit_map
+{
+  static_assert((_Bits % 64) == 0, "bit_map size has to be a multiple of 64");
+  static constexpr size_t         _num_words = _Bits / 64;
+
+public:
+  bit_map() { reset(); }
+
+  void reset() { _words.fill(0); }
+  constexpr size_t size() const { return _Bits; }
+
+  bool test(size_t bit) const
+  {
+    return ((_words[bit >> 6] >> (bit & 63)) & 1) != 0;
+  }
+
+  /**
+   * \fn  test_and_set
+   *
+   * @param  bit : size_t
+   * @return  bool previous value of the bit
+   */
+  bool test_and_set(size_t bit)
+  {
+    uint64_t mask = 1ull << (bit & 63);
+    bool result = (_words[bit >> 6] & mask) != 0;
+    _words[bit >> 6] |= mask;
+    return result;
+  }
+
+  size_t count() const
+  {
+    size_t result = 0;
+    for (uint64_t word : _words)
+      result += static_cast<size_t>(__builtin_popcountll(word));
+    return result;
+  }
+
+  /**
+   * \fn  all
+   *
+   * @param  first : size_t
+   * @param  last : size_t
+   * @return  bool true if every bit of [first,last) is set
+   */
+  bool all(size_t first, size_t last) const
+  {
+    if (first >= last)
+      return true;
+
+#if defined(__AVX2__)
+    if constexpr (_num_words == 4)
+    {
+      alignas(32) std::array<uint64_t,4> masks;
+      for (size_t index = 0; index < 4; index++)
+        masks[index] = mask(index, first, last);
+
+      __m256i bits = _mm256_load_si256(reinterpret_cast<const __m256i*>(_words.data()));
+      __m256i need = _mm256_load_si256(reinterpret_cast<const __m256i*>(masks.data()));
+      return _mm256_testc_si256(bits, need) != 0;
+    }
+#elif defined(__ARM_NEON)
+    if constexpr (_num_words == 4)
+    {
+      alignas(32) std::array<uint64_t,4> masks;
+      for (size_t index = 0; index < 4; index++)
+        masks[index] = mask(index, first, last);
+
+      uint64x2_t lo = vbicq_u64(vld1q_u64(&masks[0]), vld1q_u64(&_words[0]));
+      uint64x2_t hi = vbicq_u64(vld1q_u64(&masks[2]), vld1q_u64(&_words[2]));
+      uint64x2_t missing = vorrq_u64(lo, hi);
+      return (vgetq_lane_u64(missing, 0) | vgetq_lane_u64(missing, 1)) == 0;
+    }
+#endif
+
+    for (size_t index = first >> 6; index <= ((last - 1) >> 6); index++)
+    {
+      uint64_t need = mask(index, first, last);
+      if ((_words[index] & need) != need)
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * \fn  find_first_zero
+   *
+   * @param  first : size_t
+   * @param  last : size_t
+   * @return  size_t first clear bit of [first,last), last if there is none
+   */
+  size_t find_first_zero(size_t first, size_t last) const
+  {
+    if (first >= last)
+      return last;
+
+    for (size_t index = first >> 6; index <= ((last - 1) >> 6); index++)
+    {
+      uint64_t zeros = ~_words[index] & mask(index, first, last);
+      if (zeros != 0)
+        return (index << 6) + static_cast<size_t>(__builtin_ctzll(zeros));
+    }
+    return last;
+  }
+
+  /**
+   * \fn  find_first_set
+   *
+   * @param  first : size_t
+   * @param  last : size_t
+   * @return  size_t first set bit of [first,last), last if there is none
+   */
+  size_t find_first_set(size_t first, size_t last) const
+  {
+    if (first >= last)
+      return last;
+
+    for (size_t index = first >> 6; index <= ((last - 1) >> 6); index++)
+    {
+      uint64_t ones = _words[index] & mask(index, first, last);
+      if (ones != 0)
+        return (index << 6) + static_cast<size_t>(__builtin_ctzll(ones));
+    }
+    return last;
+  }
+
+private:
+  // Bits of word index that fall into [first,last)
+  static uint64_t mask(size_t index, size_t first, size_t last)
+  {
+    size_t lo = std::max(first, index << 6);
+    size_t hi = std::min(last, (index + 1) << 6);
+    if (lo >= hi)
+      return 0;
+
+    size_t num = hi - lo;
+    uint64_t bits = (num == 64) ? ~0ull : ((1ull << num) - 1);
+    return bits << (lo - (index << 6));
+  }
+
+  alignas(32) std::array<uint64_t,_num_words> _words;
+};
+
 /**
  * \class fixed_list
  *
@@ -347,6 +843,46 @@ public:
     }
   }
 
+  /**
+   * \fn  at
+   *
+   *  Returns iterator to the occupied slot index or end()
+   */
+  iterator at(size_t index)
+  {
+    if ((index >= _Size) || _buffer[index]._empty)
+      return end();
+
+    return iterator(&_buffer[index], _buffer.data() + _buffer.size());
+  }
+
+  const_iterator at(size_t index) const
+  {
+    if ((index >= _Size) || _buffer[index]._empty)
+      return end();
+
+    return const_iterator(&_buffer[index], _buffer.data() + _buffer.size());
+  }
+
+  size_t index(const iterator& i) const { return static_cast<size_t>(i._ptr - _buffer.data()); }
+  size_t index(const const_iterator& i) const { return static_cast<size_t>(i._ptr - _buffer.data()); }
+
+  /**
+   * \fn  push_at
+   *
+   *  Occupies the slot index, returns end() if the slot is already taken
+   */
+  iterator push_at(size_t index, const _Type& v)
+  {
+    if ((index >= _Size) || !_buffer[index]._empty)
+      return end();
+
+    _buffer[index]._v = v;
+    _buffer[index]._empty = false;
+    _num_elements++;
+    return iterator(&_buffer[index], _buffer.data() + _buffer.size());
+  }
+
   template<typename _Predicate>
   iterator find_if(_Predicate p) { return std::find_if(begin(), end(), p); }
 
@@ -356,67 +892,389 @@ public:
 
 
 /**
- * \class allocator
+ * \class pgn_table
  *
- *  Fixe size allocator for real time operations
+ *  Two level PGN dispatch table. The first level is indexed by EDP/DP/PF,
+ *  the second one by PS, which is only significant for PDU2 PGNs.
+ *  Every PGN keeps a chain of values, so several receivers can share it.
+ *  Entries are never removed, therefore readers walk the table without
+ *  any lock, while writers must be serialized by the owner.
  */
-template<typename _Type,size_t _Extrasize = 0>
-class allocator
+template<typename _Type>
+class pgn_table
 {
-  struct filler
+  struct node
   {
-    filler() : _empty(true), _allocator(nullptr), _keyword(typeid(allocator<_Type,_Extrasize>).hash_code()) 
-    { }
+    node(const _Type& v) : _v(v), _next(nullptr) {}
+    _Type                           _v;
+    std::atomic<node*>              _next;
+  };
 
-    uint8_t   _v[sizeof(_Type) + _Extrasize]   __attribute__ ((aligned (__BIGGEST_ALIGNMENT__)));
-    std::atomic_bool              _empty;
-    
-    allocator<_Type, _Extrasize>* _allocator;
-    size_t                        _keyword;
+  struct group
+  {
+    group()
+    {
+      for (auto& head : _head)
+        head.store(nullptr, std::memory_order_relaxed);
+    }
+    std::array<std::atomic<node*>,256> _head;
+  };
+
+  std::array<std::atomic<group*>,1024> _groups;
+
+  static  size_t                  group_index(uint32_t pgn) { return (pgn >> 8) & 0x3FF; }
+  static  size_t                  head_index(uint32_t pgn) { return (((pgn >> 8) & 0xFF) < 240) ? 0 : (pgn & 0xFF); }
+
+public:
+  pgn_table()
+  {
+    for (auto& grp : _groups)
+      grp.store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~pgn_table()
+  { clear(); }
+
+  pgn_table(const pgn_table&) = delete;
+  pgn_table& operator=(const pgn_table&) = delete;
+
+  /**
+   * \fn  push
+   *
+   *  Appends value to the PGN chain. Not thread safe against other writers.
+   */
+  void push(uint32_t pgn, const _Type& v)
+  {
+    std::atomic<group*>& grp_ref = _groups[group_index(pgn)];
+    group* grp = grp_ref.load(std::memory_order_acquire);
+    if (grp == nullptr)
+    {
+      grp = new group();
+      grp_ref.store(grp, std::memory_order_release);
+    }
+
+    std::atomic<node*>* link = &grp->_head[head_index(pgn)];
+    node* nd = link->load(std::memory_order_acquire);
+    while (nd != nullptr)
+    {
+      link = &nd->_next;
+      nd = link->load(std::memory_order_acquire);
+    }
+
+    link->store(new node(v), std::memory_order_release);
+  }
+
+  /**
+   * \fn  for_each
+   *
+   *  Calls fn for every value registered under pgn and returns their number
+   */
+  template<typename _Fn>
+  size_t for_each(uint32_t pgn, _Fn fn) const
+  {
+    const group* grp = _groups[group_index(pgn)].load(std::memory_order_acquire);
+    if (grp == nullptr)
+      return 0;
+
+    size_t num = 0;
+    for (const node* nd = grp->_head[head_index(pgn)].load(std::memory_order_acquire);
+            nd != nullptr; nd = nd->_next.load(std::memory_order_acquire))
+    {
+      fn(nd->_v);
+      num++;
+    }
+    return num;
+  }
+
+  bool contains(uint32_t pgn) const
+  {
+    const group* grp = _groups[group_index(pgn)].load(std::memory_order_acquire);
+    return (grp != nullptr) && (grp->_head[head_index(pgn)].load(std::memory_order_acquire) != nullptr);
+  }
+
+  void clear()
+  {
+    for (auto& grp_ref : _groups)
+    {
+      group* grp = grp_ref.exchange(nullptr);
+      if (grp == nullptr)
+        continue;
+
+      for (auto& head : grp->_head)
+      {
+        node* nd = head.exchange(nullptr);
+        while (nd != nullptr)
+        {
+          node* next = nd->_next.load();
+          delete nd;
+          nd = next;
+        }
+      }
+      delete grp;
+    }
+  }
+};
+
+
+/**
+ * \struct open_hash
+ *
+ *  Default key hash of open_table, integral keys are used as they are
+ */
+template<typename _Key>
+struct open_hash
+{
+  uint64_t operator()(const _Key& key) const { return static_cast<uint64_t>(key); }
+};
+
+/**
+ * \class open_table
+ *
+ *  Fixed size open addressing table with linear probing and backward
+ *  shift deletion, so no tombstones are left behind. A default
+ *  constructed _Key marks a free slot and is never stored. One slot
+ *  stays free so that probing always terminates. Not thread safe,
+ *  the owner serializes access.
+ */
+template<typename _Key,typename _Value,size_t _Bits,typename _Hash = open_hash<_Key>>
+class open_table
+{
+  struct slot
+  {
+    _Key                            _key;
+    _Value                          _value;
   };
 
-  filler*                         _buffer;
+  std::array<slot,(size_t(1) << _Bits)> _slots;
+  size_t                            _size;
+
+  static  size_t                  home(const _Key& key)
+  { return static_cast<size_t>((_Hash()(key) * 0x9E3779B97F4A7C15ULL) >> (64 - _Bits)); }
+
+  static  bool                    is_free(const slot& s) { return s._key == _Key(); }
+
+  /**
+   * \fn  index
+   *
+   *  Slot holding key, or the free slot where key would go
+   */
+  size_t index(const _Key& key) const
+  {
+    size_t mask = _slots.size() - 1;
+    size_t idx = home(key);
+    while (!is_free(_slots[idx]) && !(_slots[idx]._key == key))
+      idx = (idx + 1) & mask;
+
+    return idx;
+  }
+
+public:
+  open_table() : _slots(), _size(0) {}
+
+  open_table(const open_table&) = delete;
+  open_table& operator=(const open_table&) = delete;
+
+  size_t size() const { return _size; }
+
+  _Value* find(const _Key& key)
+  {
+    slot& s = _slots[index(key)];
+    return is_free(s) ? nullptr : &s._value;
+  }
+
+  const _Value* find(const _Key& key) const
+  {
+    const slot& s = _slots[index(key)];
+    return is_free(s) ? nullptr : &s._value;
+  }
+
+  /**
+   * \fn  insert
+   *
+   *  Value stored under key, a new one is default constructed.
+   *  nullptr if the table is full
+   */
+  _Value* insert(const _Key& key)
+  {
+    slot& s = _slots[index(key)];
+    if (is_free(s))
+    {
+      if (_size >= (_slots.size() - 1))
+        return nullptr;
+
+      s._key = key;
+      s._value = _Value();
+      _size++;
+    }
+    return &s._value;
+  }
+
+  bool erase(const _Key& key)
+  {
+    size_t mask = _slots.size() - 1;
+    size_t hole = index(key);
+    if (is_free(_slots[hole]))
+      return false;
+
+    _slots[hole] = slot();
+    _size--;
+
+    for (size_t next = (hole + 1) & mask; !is_free(_slots[next]); next = (next + 1) & mask)
+    {
+      // Entries whose home lies cyclically in (hole, next] stay where they are
+      size_t distance = (next - home(_slots[next]._key)) & mask;
+      if (distance >= ((next - hole) & mask))
+      {
+        _slots[hole] = _slots[next];
+        _slots[next] = slot();
+        hole = next;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * \fn  for_each
+   *
+   *  Calls fn(key, value) for every stored entry
+   */
+  template<typename _Fn>
+  void for_each(_Fn fn)
+  {
+    for (auto& s : _slots)
+    {
+      if (!is_free(s))
+        fn(s._key, s._value);
+    }
+  }
+
+  void clear()
+  {
+    for (auto& s : _slots)
+      s = slot();
+
+    _size = 0;
+  }
+};
+
+
+/**
+ * \class pool_allocator
+ *
+ *  Fixed slot allocator for real time operations. Slot size is set at
+ *  construction time.
+ *
+ *  Every pool owns one contiguous arena of slots, so ownership of a
+ *  pointer is a range check and its slot index is pointer arithmetic.
+ *  Free slots are kept in a lock-free stack (Treiber stack). The head
+ *  holds the slot index in its low 32 bits and a modification tag in the
+ *  high 32 bits, which protects pop against ABA.
+ */
+class pool_allocator
+{
+  static  constexpr uint32_t      _nil = static_cast<uint32_t>(-1);
+  static  constexpr size_t        _alignment = __BIGGEST_ALIGNMENT__;
+
+  static  uint32_t                head_index(uint64_t head) { return static_cast<uint32_t>(head & 0xFFFFFFFF); }
+  static  uint64_t                make_head(uint64_t prev, uint32_t index) { return (((prev >> 32) + 1) << 32) | index; }
+
+  uint8_t*                        _arena;
+  std::atomic_uint32_t*           _next;
+  size_t                          _slot_size;
   size_t                          _pool_size;
+  std::atomic_uint64_t            _free_head;
 
 public:
   
-  allocator(size_t pool_size = 1024) 
-  : _pool_size(pool_size)
+  pool_allocator(size_t slot_size, size_t pool_size = 1024) 
+  : _slot_size((std::max(slot_size, static_cast<size_t>(1)) + _alignment - 1) & ~(_alignment - 1))
+  , _pool_size(std::min(pool_size, static_cast<size_t>(_nil)))
+  , _free_head(_nil)
   { 
-    _buffer = new filler[pool_size];
+    _arena = reinterpret_cast<uint8_t*>(::operator new(_slot_size * _pool_size, std::align_val_t(_alignment)));
+    _next = new std::atomic_uint32_t[_pool_size];
 
-    for (size_t index = 0; index < pool_size; index++)
-      _buffer[index]._allocator = this;
+    for (size_t index = 0; index < _pool_size; index++)
+    {
+      _next[index].store((index + 1 < _pool_size) ? static_cast<uint32_t>(index + 1) : _nil, 
+                                    std::memory_order_relaxed);
+    }
+
+    if (_pool_size != 0)
+      _free_head.store(0);
+  }
+
+  ~pool_allocator() 
+  {
+    ::operator delete(_arena, std::align_val_t(_alignment));
+    delete[] _next;
   }
 
-  ~allocator() 
+  pool_allocator(const pool_allocator&) = delete;
+  pool_allocator& operator=(const pool_allocator&) = delete;
+
+  size_t slot_size() const { return _slot_size; }
+  size_t pool_size() const { return _pool_size; }
+
+  bool owns(const void* ptr) const
   {
-    delete[] _buffer;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(ptr);
+    return (p >= _arena) && (p < _arena + _slot_size * _pool_size);
   }
 
   void* allocate()
   {
-    for (size_t index = 0; index < _pool_size; index++)
+    uint64_t head = _free_head.load(std::memory_order_acquire);
+    while (head_index(head) != _nil)
     {
-      bool expected = true;
-      if (_buffer[index]._empty.compare_exchange_strong(expected, false))
-        return &_buffer[index]._v[0];
+      uint32_t index = head_index(head);
+      uint32_t next = _next[index].load(std::memory_order_relaxed);
+      if (_free_head.compare_exchange_weak(head, make_head(head, next), 
+                                    std::memory_order_acquire, std::memory_order_acquire))
+      {
+        return _arena + index * _slot_size;
+      }
     }
     return nullptr;
   }
 
-  static bool free(void* ptr)
+  /**
+   * \fn  free
+   *
+   *  Returns false if ptr doesn't belong to this allocator's arena
+   */
+  bool free(void* ptr)
   {
-    filler* fl = reinterpret_cast<filler*>(ptr);
-    if (fl->_keyword != typeid(allocator<_Type,_Extrasize>).hash_code())
+    if (!owns(ptr))
       return false;
 
-    fl->_empty.store(true);
+    uint32_t index = static_cast<uint32_t>((reinterpret_cast<uint8_t*>(ptr) - _arena) / _slot_size);
+    uint64_t head = _free_head.load(std::memory_order_relaxed);
+    do
+    {
+      _next[index].store(head_index(head), std::memory_order_relaxed);
+    } 
+    while (!_free_head.compare_exchange_weak(head, make_head(head, index), 
+                                    std::memory_order_release, std::memory_order_relaxed));
     return true;
   }
 
 };
 
+/**
+ * \class allocator
+ *
+ *  Typed pool with slots of sizeof(_Type) + _Extrasize bytes
+ */
+template<typename _Type,size_t _Extrasize = 0>
+class allocator : public pool_allocator
+{
+public:
+  allocator(size_t pool_size = 1024) 
+  : pool_allocator(sizeof(_Type) + _Extrasize, pool_size)
+  { }
+};
+
 
 template<typename _Class>
 class shared_pointer;
@@ -569,6 +1427,22 @@ inline shared_pointer<_Tp> dynamic_shared_cast(const shared_pointer<_Up>& __r) n
 }
 
 
+/**
+ * \fn  cpu_relax
+ *
+ *  Spin wait hint, used instead of std::this_thread::yield to keep the
+ *  core library free of the std threading runtime
+ */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+
 class CanProcessor;
 /**
  * \class Mutex
@@ -583,10 +1457,19 @@ public:
   virtual void                    lock();
   virtual void                    unlock();
           CanProcessor*           processor() { return _processor; }
+          bool                    is_native() const { return _native; }
+
+private:
+          void                    native_lock();
+          void                    native_unlock();
 
 private:
   uint32_t                        _mutex_id;
   CanProcessor*                   _processor;
+  bool                            _native;
+
+  // Native lock word: 0 unlocked, 1 locked, 2 locked with waiters
+  std::atomic_uint32_t            _state;
 };
 
 /**
@@ -602,6 +1485,9 @@ public:
   virtual void                    lock();
   virtual void                    unlock();
 
+private:
+          uint32_t                thread_id();
+
 private:
   std::atomic_uint32_t            _lock_counter;
   std::atomic_uint32_t            _thread_id;
@@ -42,25 +42,21 @@ LocalECU::~LocalECU()
  * \fn  LocalECU::claim_address
  *
  * @param  address : uint8_t 
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
-void LocalECU::claim_address(uint8_t address,const ConstantString& bus_name)
+void LocalECU::claim_address(uint8_t address,CanBusHandle bus)
 {
   if (address == NULL_CAN_ADDRESS)
   {
     // Claiming NULL address means we are sending Cannot Claim Address message,
     // which automatically deactivates the device
-    disable_device(bus_name);
+    disable_device(bus);
   }
   else
   {
     std::lock_guard<Mutex> l(_mutex);
 
-    auto container = _container_map.find_if([&bus_name](const Container& cntr)->bool
-        {
-          return cntr._bus_name == bus_name;
-        });
-
+    auto container = _container_map.at(bus);
     if (container == _container_map.end())
       return;
 
@@ -69,38 +65,36 @@ void LocalECU::claim_address(uint8_t address,const ConstantString& bus_name)
     container->_status = eWaiting;
     container->_time_tag = processor()->get_time_tick();
     
-    processor()->register_updater([this, bus_name]()->bool
+    // The timer keeps the ECU alive until it fires
+    auto me = getptr();
+    processor()->add_timer(container->_time_tag + CAN_ADDRESS_CLAIMED_WAITING_TIME, [me, this, bus]()
     {
       uint64_t cur_time = processor()->get_time_tick();
       {
         std::lock_guard<Mutex> l(_mutex);
-        auto container = _container_map.find_if([bus_name](const Container& cntr)->bool
-            {
-              return cntr._bus_name == bus_name;
-            });
-
+        auto container = _container_map.at(bus);
         if (container == _container_map.end())
-          return true;
+          return;
 
         if (container->_status != eWaiting)
-          return true; // remove from updaters
-       
+          return;
+
+        // A timer of a repeated claim is still pending
         if ((cur_time - container->_time_tag) < CAN_ADDRESS_CLAIMED_WAITING_TIME)
-          return false;
+          return;
 
         container->_status = eActive;
         while (!container->_fifo.empty())
         {
           Queue& queue = container->_fifo.front();
-          send_message(queue._message, queue._remote, bus_name, false);
+          send_message(queue._message, queue._remote, bus, false);
           container->_fifo.pop();
         }
       }
-      return true;
     });
   }
 
-  processor()->send_raw_packet(CanPacket(name().data(), sizeof(uint64_t), PGN_AddressClaimed, BROADCAST_CAN_ADDRESS, address),bus_name);
+  processor()->send_raw_packet(CanPacket(name().data(), sizeof(uint64_t), PGN_AddressClaimed, BROADCAST_CAN_ADDRESS, address),bus);
 }
 
 /**
@@ -108,21 +102,17 @@ void LocalECU::claim_address(uint8_t address,const ConstantString& bus_name)
  *
  * @param   message : const CanMessagePtr&
  * @param   remote : const RemoteECUPtr&
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param  check_status  : bool
  * @return  bool
  */
 bool LocalECU::send_message(const CanMessagePtr& message,const RemoteECUPtr& remote,
-                              const ConstantString& bus_name,bool check_status /*= true*/)
+                              CanBusHandle bus,bool check_status /*= true*/)
 {
   if (check_status)
   {
     std::lock_guard<Mutex> l(_mutex);
-    auto container = _container_map.find_if([&bus_name](const Container& cntr)->bool
-        {
-          return cntr._bus_name == bus_name;
-        });
-
+    auto container = _container_map.at(bus);
     if (container == _container_map.end())
       return false;
 
@@ -139,7 +129,7 @@ bool LocalECU::send_message(const CanMessagePtr& message,const RemoteECUPtr& rem
   uint8_t da = BROADCAST_CAN_ADDRESS;
   if (remote)
   {
-    da = remote->get_address(bus_name);
+    da = remote->get_address(bus);
     if (da == NULL_CAN_ADDRESS)
       return false;
   }
@@ -147,19 +137,19 @@ bool LocalECU::send_message(const CanMessagePtr& message,const RemoteECUPtr& rem
   CanProcessor::ConfirmationCallback fn;
   if (message->cback())
   {
-    CanString b_name(bus_name);
-    fn = [message, b_name](uint64_t,CanMessageConfirmation confirm)
+    CanProcessor* proc = processor();
+    fn = [message, proc, bus](uint64_t,CanMessageConfirmation confirm)
           {
-            message->callback(b_name, confirm == eMessageSent);
+            message->callback(proc->get_bus_name(bus), confirm == eMessageSent);
           };
   }
 
   if (!processor()->send_raw_packet(CanPacket(message->data(), message->length(), 
-                                              message->pgn(), da, get_address(bus_name),
-                                              message->priority()), bus_name, fn))
+                                              message->pgn(), da, get_address(bus),
+                                              message->priority()), bus, fn))
   {
     if (message->cback())
-      message->callback(bus_name, false);
+      message->callback(processor()->get_bus_name(bus), false);
     
     return false;
   }
@@ -170,16 +160,12 @@ bool LocalECU::send_message(const CanMessagePtr& message,const RemoteECUPtr& rem
 /**
  * \fn  LocalECU::disable_device
  *
- * @param bus_name : const ConstantString&
+ * @param bus : CanBusHandle
  */
-void LocalECU::disable_device(const ConstantString& bus_name)
+void LocalECU::disable_device(CanBusHandle bus)
 {
   std::lock_guard<Mutex> l(_mutex);
-  auto container = _container_map.find_if([&bus_name](const Container& cntr)->bool
-      {
-        return cntr._bus_name == bus_name;
-      });
-
+  auto container = _container_map.at(bus);
   if (container != _container_map.end())
     container->_status = eInactive;
 }
@@ -247,32 +233,42 @@ CanMessagePtr LocalECU::request_pgn(uint32_t pgn)
 void LocalECU::activate(uint8_t desired_address, const std::initializer_list<ConstantString>& buses
                                                       /* = std::initializer_list<ConstantString>() */)
 {
-  fixed_list<ConstantString,32>  bus_list(buses);
-  if (bus_list.empty())
+  fixed_list<CanBusHandle,MAX_CAN_BUSES>  bus_list;
+  if (buses.size() == 0)
     processor()->get_all_buses(bus_list);
-
-  for (auto bus_name : bus_list)
+  else
   {
-    std::lock_guard<Mutex> l(_mutex);
-    auto container = _container_map.find_if([bus_name](const Container& cntr)->bool
-        {
-          return cntr._bus_name == bus_name;
-        });
+    for (auto bus_name : buses)
+    {
+      CanBusHandle bus = processor()->get_bus_handle(bus_name);
+      if (bus != INVALID_CAN_BUS_HANDLE)
+        bus_list.push(bus);
+    }
+  }
 
-    if (container == _container_map.end())
+  for (auto bus : bus_list)
+  {
     {
-      auto res = _container_map.push(Container(bus_name));
-      if (res == _container_map.end())
-        continue;
+      std::lock_guard<Mutex> l(_mutex);
+      auto container = _container_map.at(bus);
+      if (container == _container_map.end())
+      {
+        auto res = _container_map.push_at(bus, Container());
+        if (res == _container_map.end())
+          continue;
 
-      container = res;
-    }
+        container = res;
+      }
 
-    if (container->_status != eInactive)
-      continue;
+      if (container->_status != eInactive)
+        continue;
 
-    if (processor()->activate_local_ecu(LocalECUPtr(getptr()), bus_name, desired_address))
       container->_status = eWaiting;
+    }
+
+    // Activation claims the address, which takes the lock again
+    if (!processor()->activate_local_ecu(LocalECUPtr(getptr()), bus, desired_address))
+      disable_device(bus);
   }
 }
 
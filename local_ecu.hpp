@@ -56,11 +56,11 @@ friend bool can_library_release();
 
 private:
   LocalECU(CanProcessor*,const CanName& name);
-          void                    claim_address(uint8_t address,const ConstantString& bus_name);
-          void                    disable_device(const ConstantString& bus_name);
+          void                    claim_address(uint8_t address,CanBusHandle bus);
+          void                    disable_device(CanBusHandle bus);
 
           bool                    send_message(const CanMessagePtr& message,const RemoteECUPtr& remote,
-                                              const ConstantString& bus_name,bool check_status = true);
+                                              CanBusHandle bus,bool check_status = true);
           CanMessagePtr           request_pgn(uint32_t pgn);
 
 private:
@@ -85,15 +85,15 @@ private:
 
   struct Container
   {
-    Container(const ConstantString& bus_name = ConstantString()) : _bus_name(bus_name), _status(eInactive), _time_tag(0ULL)  {}
+    Container() : _status(eInactive), _time_tag(0ULL)  {}
     
-    CanString                       _bus_name;
     ECUStatus                       _status;
     uint64_t                        _time_tag;
     fifo<Queue>                     _fifo;
   };
   
-  fixed_list<Container,32>        _container_map;
+  // Indexed by CanBusHandle
+  fixed_list<Container,MAX_CAN_BUSES> _container_map;
 };
 
 
@@ -120,25 +120,25 @@ void RemoteECU::init_status()
   _status_ready = false;
   _status_timer = processor()->get_time_tick();
   
-  processor()->register_updater([this]()->bool
+  // The timer keeps the ECU alive until it fires
+  auto me = getptr();
+  processor()->add_timer(_status_timer + CAN_ADDRESS_CLAIMED_WAITING_TIME + 1, [me, this]()
   {
     std::lock_guard<RecursiveMutex> l(_mutex);
-    if (!_status_ready)
+    if (_status_ready)
+      return;
+
+    // A later init_status restarted the wait, its own timer takes over
+    if ((processor()->get_time_tick() - _status_timer) <= CAN_ADDRESS_CLAIMED_WAITING_TIME)
+      return;
+
+    _status_ready = true;
+    while (!_queue.empty())
     {
-      if ((processor()->get_time_tick() - _status_timer) > CAN_ADDRESS_CLAIMED_WAITING_TIME)
-      {
-        _status_ready = true;
-        while (!_queue.empty())
-        {
-          MsgQueue& msg = _queue.front();
-          processor()->send_can_message(msg._message, LocalECUPtr(msg._local), RemoteECUPtr(getptr()), { msg._bus_name });
-          _queue.pop();
-        }
-
-        return true;
-      }
+      MsgQueue& msg = _queue.front();
+      processor()->send_can_message(msg._message, LocalECUPtr(msg._local), RemoteECUPtr(getptr()), msg._bus);
+      _queue.pop();
     }
-    return false;
   });
 }
 
@@ -147,16 +147,16 @@ void RemoteECU::init_status()
  *
  * @param  message : CanMessagePtr
  * @param  local :  LocalECUPtr 
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @return  bool
  */
-bool RemoteECU::queue_message(const CanMessagePtr& message, const LocalECUPtr& local, const ConstantString& bus_name)
+bool RemoteECU::queue_message(const CanMessagePtr& message, const LocalECUPtr& local, CanBusHandle bus)
 {
   std::lock_guard<RecursiveMutex> l(_mutex);
   if (_status_ready)
     return false;
   
-  _queue.push(MsgQueue(message, local, bus_name));
+  _queue.push(MsgQueue(message, local, bus));
   return true;
 }
 
@@ -44,7 +44,7 @@ private:
           
           void                    init_status();
           shared_pointer<CanTranscoder> get_requested_pgn(uint32_t pgn) const;
-          bool                    queue_message(const CanMessagePtr& message,const LocalECUPtr& local, const ConstantString& bus_name);
+          bool                    queue_message(const CanMessagePtr& message,const LocalECUPtr& local, CanBusHandle bus);
           bool                    on_message_received(const CanMessagePtr& msg);
 
           bool                    is_ready() const 
@@ -65,14 +65,14 @@ private:
 
   struct MsgQueue
   {
-    MsgQueue() = default;
-    MsgQueue(const CanMessagePtr& message,const CanECUPtr& local, const ConstantString& bus_name)
-    : _message(message), _local(local), _bus_name(bus_name)
+    MsgQueue() : _bus(INVALID_CAN_BUS_HANDLE) {}
+    MsgQueue(const CanMessagePtr& message,const CanECUPtr& local, CanBusHandle bus)
+    : _message(message), _local(local), _bus(bus)
     {   }
 
     CanMessagePtr                   _message;
     CanECUPtr                       _local;
-    CanString                       _bus_name;
+    CanBusHandle                    _bus;
   };
 
   fifo<MsgQueue>                  _queue;
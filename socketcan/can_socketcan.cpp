@@ -0,0 +1,596 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026
+ * File : can_socketcan.cpp
+ *
+ */
+
+#include "can_socketcan.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+
+namespace brt {
+namespace can {
+
+/**
+ * \fn  timespec_ns
+ *
+ * @param  ts : const struct timespec&
+ * @return  uint64_t
+ */
+static uint64_t timespec_ns(const struct timespec& ts)
+{
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000llu + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * \fn  to_packet
+ *
+ *  Only 29 bit data frames are J1939 traffic
+ *
+ * @param  frame : const struct can_frame&
+ * @param  packet : CanPacket&
+ * @return  bool
+ */
+static bool to_packet(const struct can_frame& frame, CanPacket& packet)
+{
+  if (((frame.can_id & CAN_EFF_FLAG) == 0) || ((frame.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0))
+    return false;
+
+  packet = CanPacket(frame.can_id & CAN_EFF_MASK, frame.data, frame.can_dlc);
+  return true;
+}
+
+/**
+ * \fn  to_frame
+ *
+ * @param  packet : const CanPacket&
+ * @param  frame : struct can_frame&
+ */
+static void to_frame(const CanPacket& packet, struct can_frame& frame)
+{
+  memset(&frame, 0, sizeof(frame));
+  frame.can_id = (packet.id() & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  frame.can_dlc = std::min(packet.dlc(), static_cast<uint8_t>(CAN_MAX_DLEN));
+  memcpy(frame.data, packet.data(), frame.can_dlc);
+}
+
+/**
+ * \fn  constructor SocketCanCallback::SocketCanCallback
+ *
+ */
+SocketCanCallback::SocketCanCallback()
+: _can(nullptr)
+, _num_buses(0)
+, _rx_timestamp(0)
+{
+}
+
+/**
+ * \fn  destructor SocketCanCallback::~SocketCanCallback
+ *
+ */
+SocketCanCallback::~SocketCanCallback()
+{
+  for (size_t index = 0; index < _num_buses; index++)
+  {
+    Bus& bus = _buses[index];
+    if (bus._ring != nullptr)
+      munmap(bus._ring, SOCKETCAN_RING_BLOCK_SIZE * SOCKETCAN_RING_BLOCK_NUMBER);
+
+    if (bus._ring_socket >= 0)
+      close(bus._ring_socket);
+
+    if (bus._socket >= 0)
+      close(bus._socket);
+  }
+}
+
+/**
+ * \fn  SocketCanCallback::open_bus
+ *
+ *  Opens CAN_RAW socket on the interface and registers the bus with the
+ *  attached CanInterface. Must be called after attach().
+ *
+ * @param  ifname : const char*
+ * @param  mmap_rx : bool receive through PACKET_MMAP ring instead of recvmmsg
+ * @return  CanBusHandle
+ */
+CanBusHandle SocketCanCallback::open_bus(const char* ifname, bool mmap_rx /*= false*/)
+{
+  if ((_can == nullptr) || (ifname == nullptr) || (_num_buses >= _buses.size()))
+    return INVALID_CAN_BUS_HANDLE;
+
+  int ifindex = static_cast<int>(if_nametoindex(ifname));
+  if (ifindex == 0)
+    return INVALID_CAN_BUS_HANDLE;
+
+  Bus& bus = _buses[_num_buses];
+  bus._name = ifname;
+  bus._socket = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (bus._socket < 0)
+    return INVALID_CAN_BUS_HANDLE;
+
+  // Software receive time stamps. Hardware stamps would also need the
+  // controller configured through SIOCSHWTSTAMP, which needs CAP_NET_ADMIN
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  setsockopt(bus._socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+
+  struct sockaddr_can addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifindex;
+  if (bind(bus._socket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+  {
+    close(bus._socket);
+    bus._socket = -1;
+    return INVALID_CAN_BUS_HANDLE;
+  }
+
+  if (mmap_rx)
+  {
+    // Received frames come from the ring only, an empty filter
+    // list keeps the CAN_RAW socket for transmission
+    setsockopt(bus._socket, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0);
+
+    if (!open_ring(bus, ifindex))
+    {
+      close(bus._socket);
+      bus._socket = -1;
+      return INVALID_CAN_BUS_HANDLE;
+    }
+  }
+
+  // The bus has to be visible to send_can_packet before registration,
+  // since register_can_bus transmits the initial request right away
+  _num_buses++;
+  if (!_can->register_can_bus(bus._name))
+    return INVALID_CAN_BUS_HANDLE;
+
+  bus._handle = _can->get_bus_handle(bus._name);
+  return bus._handle;
+}
+
+/**
+ * \fn  SocketCanCallback::open_ring
+ *
+ * @param  bus : Bus&
+ * @param  ifindex : int
+ * @return  bool
+ */
+bool SocketCanCallback::open_ring(Bus& bus, int ifindex)
+{
+  bus._ring_socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_CAN));
+  if (bus._ring_socket < 0)
+    return false;
+
+  int version = TPACKET_V2;
+  struct tpacket_req req;
+  req.tp_block_size = SOCKETCAN_RING_BLOCK_SIZE;
+  req.tp_block_nr   = SOCKETCAN_RING_BLOCK_NUMBER;
+  req.tp_frame_size = SOCKETCAN_RING_FRAME_SIZE;
+  req.tp_frame_nr   = (SOCKETCAN_RING_BLOCK_SIZE / SOCKETCAN_RING_FRAME_SIZE) * SOCKETCAN_RING_BLOCK_NUMBER;
+
+  struct sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family   = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_CAN);
+  addr.sll_ifindex  = ifindex;
+
+  if ((setsockopt(bus._ring_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) ||
+      (setsockopt(bus._ring_socket, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) ||
+      (bind(bus._ring_socket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0))
+  {
+    close(bus._ring_socket);
+    bus._ring_socket = -1;
+    return false;
+  }
+
+  void* ring = mmap(nullptr, SOCKETCAN_RING_BLOCK_SIZE * SOCKETCAN_RING_BLOCK_NUMBER, 
+                    PROT_READ | PROT_WRITE, MAP_SHARED, bus._ring_socket, 0);
+  if (ring == MAP_FAILED)
+  {
+    close(bus._ring_socket);
+    bus._ring_socket = -1;
+    return false;
+  }
+
+  bus._ring = reinterpret_cast<uint8_t*>(ring);
+  bus._ring_index = 0;
+  return true;
+}
+
+/**
+ * \fn  SocketCanCallback::poll
+ *
+ *  Confirms transmitted packets, waits up to timeout_ms for traffic and
+ *  dispatches every available frame to the library
+ *
+ * @param  timeout_ms : int
+ * @return  size_t number of received frames
+ */
+size_t SocketCanCallback::poll(int timeout_ms)
+{
+  confirm_sent();
+
+  size_t num_buses = _num_buses;
+  struct pollfd fds[MAX_CAN_BUSES];
+  for (size_t index = 0; index < num_buses; index++)
+  {
+    Bus& bus = _buses[index];
+    fds[index].fd = (bus._ring != nullptr) ? bus._ring_socket : bus._socket;
+    fds[index].events = POLLIN;
+    fds[index].revents = 0;
+  }
+
+  if (::poll(fds, num_buses, timeout_ms) <= 0)
+    return 0;
+
+  size_t result = 0;
+  for (size_t index = 0; index < num_buses; index++)
+  {
+    if ((fds[index].revents & POLLIN) == 0)
+      continue;
+
+    Bus& bus = _buses[index];
+    result += (bus._ring != nullptr) ? read_ring(bus) : read_socket(bus);
+  }
+
+  confirm_sent();
+  return result;
+}
+
+/**
+ * \fn  SocketCanCallback::read_socket
+ *
+ * @param  bus : Bus&
+ * @return  size_t
+ */
+size_t SocketCanCallback::read_socket(Bus& bus)
+{
+  struct can_frame  frames[SOCKETCAN_RX_BATCH_SIZE];
+  struct iovec      iov[SOCKETCAN_RX_BATCH_SIZE];
+  struct mmsghdr    msgs[SOCKETCAN_RX_BATCH_SIZE];
+  uint8_t           control[SOCKETCAN_RX_BATCH_SIZE][CMSG_SPACE(sizeof(struct timespec) * 3)];
+  CanPacket         packets[SOCKETCAN_RX_BATCH_SIZE];
+
+  size_t result = 0;
+  for (;;)
+  {
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t index = 0; index < SOCKETCAN_RX_BATCH_SIZE; index++)
+    {
+      iov[index].iov_base = &frames[index];
+      iov[index].iov_len  = sizeof(struct can_frame);
+      msgs[index].msg_hdr.msg_iov = &iov[index];
+      msgs[index].msg_hdr.msg_iovlen = 1;
+      msgs[index].msg_hdr.msg_control = control[index];
+      msgs[index].msg_hdr.msg_controllen = sizeof(control[index]);
+    }
+
+    int count = recvmmsg(bus._socket, msgs, SOCKETCAN_RX_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (count <= 0)
+      break;
+
+    size_t num_packets = 0;
+    for (int index = 0; index < count; index++)
+    {
+      if (msgs[index].msg_len < sizeof(struct can_frame))
+        continue;
+
+      if (!to_packet(frames[index], packets[num_packets]))
+        continue;
+
+      // SCM_TIMESTAMPING carries software time in [0]
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[index].msg_hdr); cmsg != nullptr; 
+                                          cmsg = CMSG_NXTHDR(&msgs[index].msg_hdr, cmsg))
+      {
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_TIMESTAMPING))
+          continue;
+
+        const struct timespec* ts = reinterpret_cast<const struct timespec*>(CMSG_DATA(cmsg));
+        _rx_timestamp = timespec_ns(ts[0]);
+      }
+      num_packets++;
+    }
+
+    if (num_packets != 0)
+      _can->received_can_packets(packets, num_packets, bus._handle);
+
+    result += num_packets;
+    if (count < SOCKETCAN_RX_BATCH_SIZE)
+      break;
+  }
+  return result;
+}
+
+/**
+ * \fn  SocketCanCallback::read_ring
+ *
+ *  Frames are read in place from the PACKET_MMAP ring and the slots are
+ *  handed back to the kernel after the burst is dispatched
+ *
+ * @param  bus : Bus&
+ * @return  size_t
+ */
+size_t SocketCanCallback::read_ring(Bus& bus)
+{
+  const size_t num_frames = (SOCKETCAN_RING_BLOCK_SIZE / SOCKETCAN_RING_FRAME_SIZE) * SOCKETCAN_RING_BLOCK_NUMBER;
+  CanPacket         packets[SOCKETCAN_RX_BATCH_SIZE];
+  struct tpacket2_hdr* slots[SOCKETCAN_RX_BATCH_SIZE];
+
+  size_t result = 0;
+  for (;;)
+  {
+    size_t num_slots = 0, num_packets = 0;
+    while (num_slots < SOCKETCAN_RX_BATCH_SIZE)
+    {
+      struct tpacket2_hdr* hdr = reinterpret_cast<struct tpacket2_hdr*>(bus._ring + bus._ring_index * SOCKETCAN_RING_FRAME_SIZE);
+      if ((__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+        break;
+
+      slots[num_slots++] = hdr;
+      bus._ring_index = (bus._ring_index + 1) % num_frames;
+
+      const struct sockaddr_ll* sll = reinterpret_cast<const struct sockaddr_ll*>(
+                      reinterpret_cast<uint8_t*>(hdr) + TPACKET_ALIGN(sizeof(struct tpacket2_hdr)));
+      if ((sll->sll_pkttype == PACKET_OUTGOING) || (hdr->tp_snaplen < sizeof(struct can_frame)))
+        continue;
+
+      const struct can_frame* frame = reinterpret_cast<const struct can_frame*>(
+                      reinterpret_cast<uint8_t*>(hdr) + hdr->tp_mac);
+      if (to_packet(*frame, packets[num_packets]))
+      {
+        _rx_timestamp = static_cast<uint64_t>(hdr->tp_sec) * 1000000000llu + hdr->tp_nsec;
+        num_packets++;
+      }
+    }
+
+    if (num_packets != 0)
+      _can->received_can_packets(packets, num_packets, bus._handle);
+
+    for (size_t index = 0; index < num_slots; index++)
+      __atomic_store_n(&slots[index]->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+    result += num_packets;
+    if (num_slots < SOCKETCAN_RX_BATCH_SIZE)
+      break;
+  }
+  return result;
+}
+
+/**
+ * \fn  SocketCanCallback::confirm_sent
+ *
+ */
+void SocketCanCallback::confirm_sent()
+{
+  std::vector<std::pair<uint64_t,CanMessageConfirmation>> pending;
+  {
+    std::lock_guard<std::mutex> l(_pending_lock);
+    pending.swap(_pending);
+  }
+
+  for (auto& confirm : pending)
+    _can->can_packet_confirm(confirm.first, confirm.second);
+}
+
+/**
+ * \fn  SocketCanCallback::find_bus
+ *
+ * @param  name : const ConstantString&
+ * @return  Bus*
+ */
+SocketCanCallback::Bus* SocketCanCallback::find_bus(const ConstantString& name)
+{
+  size_t num_buses = _num_buses;
+  for (size_t index = 0; index < num_buses; index++)
+  {
+    if (_buses[index]._name == name)
+      return &_buses[index];
+  }
+  return nullptr;
+}
+
+/**
+ * \fn  SocketCanCallback::get_time_tick_nanoseconds
+ *
+ * @return  uint64_t
+ */
+uint64_t SocketCanCallback::get_time_tick_nanoseconds() const
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return timespec_ns(ts);
+}
+
+/**
+ * \fn  SocketCanCallback::message_received
+ *
+ */
+void SocketCanCallback::message_received(const CanMessagePtr& message,const LocalECUPtr& local,
+                                const RemoteECUPtr& remote,const ConstantString& bus_name)
+{
+  if (_on_message)
+    _on_message(message, local, remote, bus_name);
+}
+
+/**
+ * \fn  SocketCanCallback::on_remote_ecu
+ *
+ */
+void SocketCanCallback::on_remote_ecu(const RemoteECUPtr& remote,const ConstantString& bus_name)
+{
+  if (_on_remote)
+    _on_remote(remote, bus_name);
+}
+
+/**
+ * \fn  SocketCanCallback::send_can_packet
+ *
+ * @param  bus_name : const ConstantString&
+ * @param  packet : const CanPacket&
+ */
+void SocketCanCallback::send_can_packet(const ConstantString& bus_name, const CanPacket& packet)
+{
+  send_can_packets(bus_name, &packet, 1);
+}
+
+/**
+ * \fn  SocketCanCallback::send_can_packets
+ *
+ *  ENOBUFS means the qdisc or the driver queue is full and does not clear
+ *  POLLOUT, so a busy or bus-off controller is waited for at most
+ *  SOCKETCAN_TX_TIMEOUT_MS. Frames still unsent after that are confirmed
+ *  as failed.
+ *
+ * @param  bus_name : const ConstantString&
+ * @param  packets : const CanPacket*
+ * @param  count : size_t
+ */
+void SocketCanCallback::send_can_packets(const ConstantString& bus_name, const CanPacket* packets, size_t count)
+{
+  Bus* bus = find_bus(bus_name);
+  size_t sent = 0;
+  uint64_t deadline = 0;
+
+  while ((bus != nullptr) && (sent < count))
+  {
+    struct can_frame  frames[SOCKETCAN_RX_BATCH_SIZE];
+    struct iovec      iov[SOCKETCAN_RX_BATCH_SIZE];
+    struct mmsghdr    msgs[SOCKETCAN_RX_BATCH_SIZE];
+
+    size_t chunk = std::min(count - sent, static_cast<size_t>(SOCKETCAN_RX_BATCH_SIZE));
+    memset(msgs, 0, sizeof(struct mmsghdr) * chunk);
+    for (size_t index = 0; index < chunk; index++)
+    {
+      to_frame(packets[sent + index], frames[index]);
+      iov[index].iov_base = &frames[index];
+      iov[index].iov_len  = sizeof(struct can_frame);
+      msgs[index].msg_hdr.msg_iov = &iov[index];
+      msgs[index].msg_hdr.msg_iovlen = 1;
+    }
+
+    int result = sendmmsg(bus->_socket, msgs, static_cast<unsigned int>(chunk), 0);
+    if (result <= 0)
+    {
+      if ((result < 0) && ((errno == EAGAIN) || (errno == ENOBUFS)))
+      {
+        // Controller TX queue is full, wait for room
+        uint64_t now = get_time_tick_nanoseconds();
+        if (deadline == 0)
+          deadline = now + SOCKETCAN_TX_TIMEOUT_MS * 1000000ULL;
+
+        if (now < deadline)
+        {
+          int wait_ms = static_cast<int>(std::min(static_cast<uint64_t>((deadline - now) / 1000000ULL + 1),
+                                                  static_cast<uint64_t>(SOCKETCAN_TX_POLL_MS)));
+          struct pollfd fd = { bus->_socket, POLLOUT, 0 };
+          if (::poll(&fd, 1, wait_ms) < 0)
+            break;
+          continue;
+        }
+      }
+      break;
+    }
+
+    std::lock_guard<std::mutex> l(_pending_lock);
+    for (int index = 0; index < result; index++)
+      _pending.push_back(std::make_pair(packets[sent + index].unique_id(), eMessageSent));
+
+    sent += static_cast<size_t>(result);
+    deadline = 0;
+  }
+
+  if (sent < count)
+  {
+    std::lock_guard<std::mutex> l(_pending_lock);
+    for (size_t index = sent; index < count; index++)
+      _pending.push_back(std::make_pair(packets[index].unique_id(), eMessageFailed));
+  }
+}
+
+/**
+ * \fn  SocketCanCallback::create_mutex
+ *
+ * @return  uint32_t
+ */
+uint32_t SocketCanCallback::create_mutex()
+{
+  std::lock_guard<std::mutex> l(_mutex_lock);
+  _mutexes.emplace_back(new std::recursive_mutex());
+  return static_cast<uint32_t>(_mutexes.size() - 1);
+}
+
+/**
+ * \fn  SocketCanCallback::delete_mutex
+ *
+ *  Ids are indexes, so the slot is kept until the callback goes away
+ *
+ * @param  mutex_id : uint32_t
+ */
+void SocketCanCallback::delete_mutex(uint32_t)
+{
+}
+
+/**
+ * \fn  SocketCanCallback::lock_mutex
+ *
+ * @param  mutex_id : uint32_t
+ */
+void SocketCanCallback::lock_mutex(uint32_t mutex_id)
+{
+  std::recursive_mutex* mtx = nullptr;
+  {
+    std::lock_guard<std::mutex> l(_mutex_lock);
+    mtx = _mutexes[mutex_id].get();
+  }
+  mtx->lock();
+}
+
+/**
+ * \fn  SocketCanCallback::unlock_mutex
+ *
+ * @param  mutex_id : uint32_t
+ */
+void SocketCanCallback::unlock_mutex(uint32_t mutex_id)
+{
+  std::recursive_mutex* mtx = nullptr;
+  {
+    std::lock_guard<std::mutex> l(_mutex_lock);
+    mtx = _mutexes[mutex_id].get();
+  }
+  mtx->unlock();
+}
+
+/**
+ * \fn  SocketCanCallback::get_current_thread_id
+ *
+ * @return  uint32_t
+ */
+uint32_t SocketCanCallback::get_current_thread_id() const
+{
+  return static_cast<uint32_t>(syscall(SYS_gettid));
+}
+
+} // can
+} // brt
+
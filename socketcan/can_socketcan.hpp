@@ -0,0 +1,130 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026
+ * File : can_socketcan.hpp
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "can_library.hpp"
+
+namespace brt {
+namespace can {
+
+#define SOCKETCAN_RX_BATCH_SIZE             (64)
+#define SOCKETCAN_RING_FRAME_SIZE           (128)
+#define SOCKETCAN_RING_BLOCK_SIZE           (4096)
+#define SOCKETCAN_RING_BLOCK_NUMBER         (64)
+#define SOCKETCAN_TX_TIMEOUT_MS             (50)
+#define SOCKETCAN_TX_POLL_MS                (10)
+
+/**
+ * \class SocketCanCallback
+ *
+ *  Reference CanInterface::Callback on top of Linux SocketCAN (CAN_RAW).
+ *  Received frames are read in bursts with recvmmsg, or from a
+ *  PACKET_MMAP RX ring when requested, and handed to the library with
+ *  received_can_packets. Outgoing bursts go out with one sendmmsg.
+ *
+ *  Sent packets are confirmed to the library from poll(), outside of the
+ *  send call, so confirmations never re-enter the processor while it is
+ *  transmitting.
+ *
+ *  usage:
+ *    SocketCanCallback cback;
+ *    CanInterface* can = create_can_interface(&cback);
+ *    cback.attach(can);
+ *    cback.open_bus("vcan0");
+ *    while (running)
+ *    {
+ *      // update() tells when it is due again, poll sleeps until then
+ *      uint64_t due = can->update();
+ *      cback.poll((due == CAN_NO_DEADLINE) ? 100 : ms_until(due));
+ *    }
+ */
+class SocketCanCallback : public CanInterface::Callback
+{
+public:
+  typedef std::function<void(const CanMessagePtr&,const LocalECUPtr&,const RemoteECUPtr&,const ConstantString&)>  MessageCallback;
+  typedef std::function<void(const RemoteECUPtr&,const ConstantString&)>   RemoteCallback;
+
+  SocketCanCallback();
+  virtual ~SocketCanCallback();
+
+          void                    attach(CanInterface* can) { _can = can; }
+          CanBusHandle            open_bus(const char* ifname, bool mmap_rx = false);
+          size_t                  poll(int timeout_ms);
+
+          void                    on_message(const MessageCallback& fn) { _on_message = fn; }
+          void                    on_remote(const RemoteCallback& fn) { _on_remote = fn; }
+
+          // Kernel software receive time of the last frame of the burst
+          // being dispatched
+          uint64_t                rx_timestamp() const { return _rx_timestamp; }
+
+  // CanInterface::Callback
+  virtual uint64_t                get_time_tick_nanoseconds() const;
+  virtual void                    message_received(const CanMessagePtr& message,const LocalECUPtr& local,const RemoteECUPtr& remote,const ConstantString& bus_name);
+  virtual void                    send_can_packet(const ConstantString& bus, const CanPacket& packet);
+  virtual void                    send_can_packets(const ConstantString& bus, const CanPacket* packets, size_t count);
+  virtual void                    on_remote_ecu(const RemoteECUPtr& remote,const ConstantString& bus_name);
+
+  virtual uint32_t                create_mutex();
+  virtual void                    delete_mutex(uint32_t mutex_id);
+  virtual void                    lock_mutex(uint32_t mutex_id);
+  virtual void                    unlock_mutex(uint32_t mutex_id);
+  virtual uint32_t                get_current_thread_id() const;
+
+private:
+  /**
+   * \struct Bus
+   *
+   */
+  struct Bus
+  {
+    Bus() : _handle(INVALID_CAN_BUS_HANDLE), _socket(-1), _ring_socket(-1), _ring(nullptr), _ring_index(0) {}
+
+    CanString                     _name;
+    CanBusHandle                  _handle;
+    int                           _socket;
+    int                           _ring_socket;
+    uint8_t*                      _ring;
+    size_t                        _ring_index;
+  };
+
+          Bus*                    find_bus(const ConstantString& name);
+          bool                    open_ring(Bus& bus, int ifindex);
+          size_t                  read_socket(Bus& bus);
+          size_t                  read_ring(Bus& bus);
+          void                    confirm_sent();
+
+private:
+  CanInterface*                   _can;
+  std::array<Bus,MAX_CAN_BUSES>   _buses;
+  std::atomic_size_t              _num_buses;
+  uint64_t                        _rx_timestamp;
+
+  MessageCallback                 _on_message;
+  RemoteCallback                  _on_remote;
+
+  std::mutex                      _pending_lock;
+  std::vector<std::pair<uint64_t,CanMessageConfirmation>> _pending;
+
+  std::mutex                      _mutex_lock;
+  std::vector<std::unique_ptr<std::recursive_mutex>> _mutexes;
+};
+
+} // can
+} // brt
+
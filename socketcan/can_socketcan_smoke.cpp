@@ -0,0 +1,151 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026
+ * File : can_socketcan_smoke.cpp
+ *
+ * Manual smoke run of the SocketCAN backend. Two interfaces share one
+ * CAN interface, both claim an address and the first sends a transport
+ * protocol message to the second.
+ *
+ * usage:
+ *    ip link add dev vcan0 type vcan && ip link set up vcan0
+ *    can_socketcan_smoke [ifname] [message_size] [mmap]
+ */
+
+#include "can_socketcan.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace brt::can;
+
+#define SMOKE_ADDRESS_A                     (0x80)
+#define SMOKE_ADDRESS_B                     (0x81)
+#define SMOKE_NAME_A                        (0x0000000000000001llu)
+#define SMOKE_NAME_B                        (0x0000000000000002llu)
+#define SMOKE_MESSAGE_SIZE                  (100)
+#define SMOKE_TIMEOUT_MS                    (3000)
+
+/**
+ * \fn  run_for
+ *
+ *  Drives both sides until *done is set or timeout_ms elapses
+ *
+ * @param  cbacks : SocketCanCallback*
+ * @param  cans : CanInterface**
+ * @param  timeout_ms : uint64_t
+ * @param  done : const bool*
+ * @return  bool
+ */
+static bool run_for(SocketCanCallback* cbacks, CanInterface** cans, uint64_t timeout_ms, const bool* done)
+{
+  uint64_t deadline = cbacks[0].get_time_tick_nanoseconds() + timeout_ms * 1000000ULL;
+  while (cbacks[0].get_time_tick_nanoseconds() < deadline)
+  {
+    if ((done != nullptr) && *done)
+      return true;
+
+    for (size_t index = 0; index < 2; index++)
+    {
+      cans[index]->update();
+      cbacks[index].poll(1);
+    }
+  }
+  return (done == nullptr) || *done;
+}
+
+/**
+ * \fn  main
+ *
+ * @param  argc : int
+ * @param  argv : char**
+ * @return  int
+ */
+int main(int argc, char** argv)
+{
+  const char* ifname = (argc > 1) ? argv[1] : "vcan0";
+  uint32_t size = (argc > 2) ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 0)) : SMOKE_MESSAGE_SIZE;
+  bool mmap_rx = (argc > 3) && (strcmp(argv[3], "mmap") == 0);
+
+  if (!can_library_init())
+    return 2;
+
+  SocketCanCallback cbacks[2];
+  CanInterface* cans[2] = { create_can_interface(&cbacks[0]), create_can_interface(&cbacks[1]) };
+
+  bool received = false;
+  bool valid = false;
+  cbacks[1].on_message([&](const CanMessagePtr& message,const LocalECUPtr&,const RemoteECUPtr&,const ConstantString&)
+  {
+    if (message->pgn() != PGN_ProprietaryA)
+      return;
+
+    valid = (message->length() == size);
+    for (uint32_t index = 0; valid && (index < size); index++)
+      valid = (message->data()[index] == static_cast<uint8_t>(index));
+    received = true;
+  });
+
+  int result = 1;
+  for (size_t index = 0; index < 2; index++)
+  {
+    cbacks[index].attach(cans[index]);
+    if (cbacks[index].open_bus(ifname, mmap_rx) == INVALID_CAN_BUS_HANDLE)
+    {
+      fprintf(stderr, "cannot open %s\n", ifname);
+      goto done;
+    }
+  }
+
+  {
+    LocalECUPtr local_a = cans[0]->create_local_ecu(CanName(SMOKE_NAME_A));
+    LocalECUPtr local_b = cans[1]->create_local_ecu(CanName(SMOKE_NAME_B));
+
+    run_for(cbacks, cans, CAN_ADDRESS_CLAIMED_WAITING_TIME * 2, nullptr);
+    local_a->activate(SMOKE_ADDRESS_A, { ifname });
+    local_b->activate(SMOKE_ADDRESS_B, { ifname });
+    run_for(cbacks, cans, CAN_ADDRESS_CLAIMED_WAITING_TIME * 2, nullptr);
+
+    RemoteECUPtr remote_b;
+    fixed_list<RemoteECUPtr> remotes;
+    cans[0]->get_remote_ecus(remotes, { ifname });
+    for (auto& remote : remotes)
+    {
+      if (remote->name().data64() == SMOKE_NAME_B)
+        remote_b = remote;
+    }
+
+    if (!remote_b)
+    {
+      fprintf(stderr, "address claim of the peer was not seen on %s\n", ifname);
+      goto done;
+    }
+
+    CanMessagePtr message(size, PGN_ProprietaryA);
+    for (uint32_t index = 0; index < size; index++)
+      message->data()[index] = static_cast<uint8_t>(index);
+
+    if (!cans[0]->send_can_message(message, local_a, remote_b, { ifname }))
+    {
+      fprintf(stderr, "send_can_message failed\n");
+      goto done;
+    }
+
+    if (!run_for(cbacks, cans, SMOKE_TIMEOUT_MS, &received))
+    {
+      fprintf(stderr, "%u byte message was not received within %u ms\n", size, SMOKE_TIMEOUT_MS);
+      goto done;
+    }
+
+    printf("%s: %u byte message %s\n", ifname, size, valid ? "received" : "corrupted");
+    result = valid ? 0 : 1;
+  }
+
+done:
+  delete_can_interface(cans[0]);
+  delete_can_interface(cans[1]);
+  can_library_release();
+  return result;
+}
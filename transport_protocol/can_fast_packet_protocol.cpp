@@ -0,0 +1,290 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026 10:12:31
+ * File : can_fast_packet_protocol.cpp
+ *
+ */
+
+#include "can_fast_packet_protocol.hpp"
+#include "can_processor.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+
+namespace brt {
+namespace can {
+
+/**
+ * \fn  constructor FastPacketProtocol::FastPacketProtocol
+ *
+ * @param  processor : CanProcessor*
+ */
+FastPacketProtocol::FastPacketProtocol(CanProcessor* processor)
+: CanProtocol(processor)
+, _mutex(processor)
+{
+  _sequence.fill(0);
+}
+
+/**
+ * \fn  destructor FastPacketProtocol::~FastPacketProtocol
+ *
+ */
+FastPacketProtocol::~FastPacketProtocol()
+{
+  _pgns.clear();
+}
+
+/**
+ * \fn  FastPacketProtocol::register_pgn
+ *
+ *  Selects Fast Packet for pgn in both directions
+ *
+ * @param  pgn : uint32_t
+ */
+void FastPacketProtocol::register_pgn(uint32_t pgn)
+{
+  {
+    std::lock_guard<Mutex> lock(_mutex);
+    if (_pgns.contains(pgn))
+      return;
+
+    _pgns.push(pgn, true);
+  }
+
+  processor()->register_pgn_receiver(pgn, [this](const CanPacket& packet,CanBusHandle bus)
+  { on_pgn_callback(packet,bus); } );
+}
+
+/**
+ * \fn  FastPacketProtocol::send_message
+ *
+ *  All frames of the message are handed to the driver in one burst.
+ *  Fast Packet has no retransmission, so the message callback reports
+ *  success only once every frame has been confirmed as sent
+ *
+ * @param   message : const CanMessagePtr&
+ * @param   local : const LocalECUPtr&
+ * @param   remote : const RemoteECUPtr&
+ * @param   bus :  CanBusHandle
+ * @return  bool
+ */
+bool FastPacketProtocol::send_message(const CanMessagePtr& message,const LocalECUPtr& local,
+                              const RemoteECUPtr& remote, CanBusHandle bus)
+{
+  if ((message->length() == 0) || (message->length() > MAX_FAST_PACKET_DATA_SIZE))
+    return false;
+
+  if (!_pgns.contains(message->pgn()))
+    return false;
+
+  uint8_t sa = local->get_address(bus);
+  uint8_t da = remote ? remote->get_address(bus) : BROADCAST_CAN_ADDRESS;
+  if ((sa >= NULL_CAN_ADDRESS) || (da == NULL_CAN_ADDRESS))
+  {
+    if (message->cback())
+      message->callback(processor()->get_bus_name(bus), false);
+
+    return true;
+  }
+
+  uint8_t sequence;
+  {
+    std::lock_guard<Mutex> lock(_mutex);
+    sequence = _sequence[sa];
+    _sequence[sa] = (sequence + 1) & 7;
+  }
+
+  std::array<CanPacket,MAX_FAST_PACKET_FRAMES> frames;
+  size_t num_frames = 0;
+  const uint8_t* data = message->data();
+  uint32_t offset = 0;
+
+  while (offset < message->length())
+  {
+    uint8_t frame[8];
+    memset(frame, 0xFF, sizeof(frame));
+    frame[0] = static_cast<uint8_t>((sequence << 5) | num_frames);
+
+    uint32_t size;
+    if (num_frames == 0)
+    {
+      frame[1] = static_cast<uint8_t>(message->length());
+      size = std::min<uint32_t>(6, message->length());
+      memcpy(frame + 2, data, size);
+    }
+    else
+    {
+      size = std::min<uint32_t>(7, message->length() - offset);
+      memcpy(frame + 1, data + offset, size);
+    }
+
+    frames[num_frames++] = CanPacket(frame, 8, message->pgn(), da, sa, message->priority());
+    offset += size;
+  }
+
+  CanProcessor::ConfirmationCallback fn;
+  if (message->cback())
+  {
+    CanProcessor* proc = processor();
+    std::shared_ptr<FrameConfirmation> state(new FrameConfirmation(num_frames));
+    fn = [message, proc, bus, state](uint64_t,CanMessageConfirmation confirm)
+          {
+            if (confirm != eMessageSent)
+              state->_failed.store(true);
+
+            if (--state->_pending == 0)
+              message->callback(proc->get_bus_name(bus), !state->_failed.load());
+          };
+  }
+
+  if (!processor()->send_raw_packets(frames.data(), num_frames, bus, fn, true) && message->cback())
+    message->callback(processor()->get_bus_name(bus), false);
+
+  return true;
+}
+
+/**
+ * \fn  FastPacketProtocol::on_pgn_callback
+ *
+ * @param   packet : const CanPacket&
+ * @param   bus : CanBusHandle
+ */
+void FastPacketProtocol::on_pgn_callback(const CanPacket& packet,CanBusHandle bus)
+{
+  if (packet.dlc() < 2)
+    return;
+
+  LocalECUPtr local(processor()->device_db().get_ecu_by_address(packet.da(),bus));
+  if (!packet.is_broadcast() && !local)
+    return;
+
+  uint8_t sequence = packet.data()[0] >> 5;
+  uint32_t frame = packet.data()[0] & 0x1F;
+  uint64_t assembly_key = key(bus, packet.pgn(), packet.sa(), sequence);
+
+  CanMessagePtr message;
+  {
+    std::lock_guard<Mutex> lock(_mutex);
+    Assembly* assembly;
+    if (frame == 0)
+    {
+      assembly = acquire(assembly_key, processor()->get_time_tick());
+      if (assembly == nullptr)
+        return;
+
+      uint32_t length = std::min<uint32_t>(packet.data()[1], MAX_FAST_PACKET_DATA_SIZE);
+      assembly->_key = assembly_key;
+
+      CanBufferProvider* provider = processor()->rx_buffer_provider();
+      uint8_t* data = (provider != nullptr) ? provider->acquire(packet.pgn(), length, bus) : nullptr;
+      if (data != nullptr)
+        assembly->_message = CanMessagePtr(CanBuffer(data, length, provider), packet.pgn(), packet.priority());
+      else
+        assembly->_message = CanMessagePtr(length, packet.pgn(), packet.priority());
+
+      assembly->_received = 0;
+      // First frame carries 6 bytes, every following frame up to 7
+      uint32_t rest = (length > 6) ? length - 6 : 0;
+      assembly->_frames = 1 + rest / 7 + (((rest % 7) != 0) ? 1 : 0);
+      assembly->_time_tag = processor()->get_time_tick();
+
+      if (!assembly->_message)
+      {
+        *assembly = Assembly();
+        return;
+      }
+
+      uint32_t size = std::min<uint32_t>({ 6, length, static_cast<uint32_t>(packet.dlc() - 2) });
+      memcpy(assembly->_message->data(), packet.data() + 2, size);
+    }
+    else
+    {
+      assembly = find(assembly_key);
+      // Frames of a message whose first frame got lost are dropped
+      if ((assembly == nullptr) || (frame >= assembly->_frames))
+        return;
+
+      uint32_t offset = 6 + (frame - 1) * 7;
+      uint32_t size = std::min<uint32_t>({ 7, assembly->_message->length() - offset,
+                                           static_cast<uint32_t>(packet.dlc() - 1) });
+      memcpy(assembly->_message->data() + offset, packet.data() + 1, size);
+      assembly->_time_tag = processor()->get_time_tick();
+    }
+
+    assembly->_received |= (1ul << frame);
+    if (assembly->_received != ((assembly->_frames == 32) ? 0xFFFFFFFFul : ((1ul << assembly->_frames) - 1)))
+      return;
+
+    message = assembly->_message;
+    *assembly = Assembly();
+  }
+
+  RemoteECUPtr remote(processor()->device_db().get_ecu_by_address(packet.sa(),bus));
+  processor()->message_received(message, local, remote, bus);
+}
+
+/**
+ * \fn  FastPacketProtocol::key
+ *
+ * @param  bus : CanBusHandle
+ * @param  pgn : uint32_t
+ * @param  sa : uint8_t
+ * @param  sequence : uint8_t
+ * @return  uint64_t, never 0 which marks a free slot
+ */
+uint64_t FastPacketProtocol::key(CanBusHandle bus,uint32_t pgn,uint8_t sa,uint8_t sequence)
+{
+  return (1ull << 63) | (static_cast<uint64_t>(bus) << 32) |
+          (static_cast<uint64_t>(pgn & 0x3FFFF) << 12) | (static_cast<uint64_t>(sa) << 4) | (sequence & 7);
+}
+
+/**
+ * \fn  FastPacketProtocol::find
+ *
+ * @param  key : uint64_t
+ * @return  Assembly*
+ */
+FastPacketProtocol::Assembly* FastPacketProtocol::find(uint64_t key)
+{
+  for (auto& assembly : _assembly)
+  {
+    if (assembly._key == key)
+      return &assembly;
+  }
+  return nullptr;
+}
+
+/**
+ * \fn  FastPacketProtocol::acquire
+ *
+ *  Slot for a new message, a repeated first frame restarts the
+ *  reassembly in place. Slots idle longer than FAST_PACKET_TIMEOUT
+ *  are reused.
+ *
+ * @param  key : uint64_t
+ * @param  time_tick : uint64_t
+ * @return  Assembly*
+ */
+FastPacketProtocol::Assembly* FastPacketProtocol::acquire(uint64_t key,uint64_t time_tick)
+{
+  Assembly* result = nullptr;
+  for (auto& assembly : _assembly)
+  {
+    if (assembly._key == key)
+      return &assembly;
+
+    if ((result == nullptr) &&
+        ((assembly._key == 0) || ((time_tick - assembly._time_tag) > FAST_PACKET_TIMEOUT)))
+    {
+      result = &assembly;
+    }
+  }
+
+  return result;
+}
+
+} // can
+} // brt
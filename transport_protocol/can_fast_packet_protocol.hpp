@@ -0,0 +1,95 @@
+/**
+ *
+ * Author : Author Daniel Movsesyan
+ * Created On : 10/17/2026 10:12:31
+ * File : can_fast_packet_protocol.hpp
+ *
+ */
+
+#pragma once
+
+#include "can_protocol.hpp"
+#include "can_message.hpp"
+#include "can_ecu.hpp"
+#include "can_utils.hpp"
+#include "can_transport_defines.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace brt {
+namespace can {
+
+/**
+ * \class FastPacketProtocol
+ *
+ * Inherited from :
+ *             CanProtocol
+ *
+ *  NMEA 2000 Fast Packet transport for messages of up to
+ *  MAX_FAST_PACKET_DATA_SIZE bytes. Only PGNs registered with
+ *  register_pgn are sent and received this way, everything else
+ *  falls through to the next protocol on the transport stack.
+ *  A registered PGN is always Fast Packet framed, short messages
+ *  included, since the receiver parses every frame of it that way.
+ */
+class FastPacketProtocol : public CanProtocol
+{
+public:
+  FastPacketProtocol(CanProcessor* processor);
+  virtual ~FastPacketProtocol();
+
+  virtual bool                    send_message(const CanMessagePtr& message,const LocalECUPtr& local,
+                                            const RemoteECUPtr& remote, CanBusHandle bus);
+
+          void                    register_pgn(uint32_t pgn);
+
+private:
+          void                    on_pgn_callback(const CanPacket&,CanBusHandle);
+
+private:
+  /**
+   * \struct Assembly
+   *
+   *  One message being reassembled, keyed by bus, PGN, source
+   *  address and the 3 bit sequence counter of the sender
+   */
+  struct Assembly
+  {
+    Assembly() : _key(0), _received(0), _frames(0), _time_tag(0ULL) {}
+
+    uint64_t                        _key;
+    CanMessagePtr                   _message;
+    uint32_t                        _received;
+    uint32_t                        _frames;
+    uint64_t                        _time_tag;
+  };
+
+  /**
+   * \struct FrameConfirmation
+   *
+   *  Shared by the confirmations of all frames of one sent message
+   */
+  struct FrameConfirmation
+  {
+    explicit FrameConfirmation(size_t frames) : _pending(frames), _failed(false) {}
+
+    std::atomic_size_t              _pending;
+    std::atomic_bool                _failed;
+  };
+
+  static  uint64_t                key(CanBusHandle bus,uint32_t pgn,uint8_t sa,uint8_t sequence);
+          Assembly*               find(uint64_t key);
+          Assembly*               acquire(uint64_t key,uint64_t time_tick);
+
+  Mutex                           _mutex;
+  pgn_table<bool>                 _pgns;
+  std::array<Assembly,FAST_PACKET_RX_SLOTS> _assembly;
+
+  // Next TX sequence counter, per source address
+  std::array<uint8_t,256>         _sequence;
+};
+
+} // can
+} // brt
@@ -20,6 +20,24 @@
 #define MAX_TP_PACKETS                      (255)
 #define MAX_TP_DATA_SIZE                    (MAX_TP_PACKETS * 7)
 #define MAX_CTS_ATTEMPTS                    (2)
+#define MAX_TP_TX_BATCH                     (16) // DT packets per driver call
+
+// Adaptive CTS window, see LibraryConfig::_adaptive_cts_window
+#define CTS_ADAPTIVE_INITIAL_WINDOW         (4)
+#define CTS_ADAPTIVE_FAST_PACKET_TIME       (2) // ms per DT packet
+
+// Session table slots per direction, one slot per (bus, sa, da)
+#define TRANSPORT_SESSION_SLOTS_BITS        (8)
+
+// ISO 11783-3:2018 6.2 Extended transport protocol
+#define MAX_ETP_PACKETS                     (0xFFFFFF)
+#define MAX_ETP_DATA_SIZE                   (MAX_ETP_PACKETS * 7)
+
+// NMEA 2000 Fast Packet, 6 data bytes in the first frame and 7 in the others
+#define MAX_FAST_PACKET_FRAMES              (32)
+#define MAX_FAST_PACKET_DATA_SIZE           (6 + (MAX_FAST_PACKET_FRAMES - 1) * 7)
+#define FAST_PACKET_RX_SLOTS                (32)
+#define FAST_PACKET_TIMEOUT                 (TRANSPORT_TIMEOUT_T1) // ms
 
 namespace brt {
 namespace can {
@@ -34,7 +52,13 @@ enum TPControlByte
   CTS = 17,
   EOM = 19, // End of message ACK
   Abort = 255,
-  BAM = 32
+  BAM = 32,
+
+  // Extended transport protocol
+  ETP_RTS = 20,
+  ETP_CTS = 21,
+  ETP_DPO = 22, // Data packet offset
+  ETP_EOM = 23  // End of message ACK
 };
 
 /**
@@ -28,13 +28,17 @@ CanTransportProtocol::CanTransportProtocol(CanProcessor* processor)
 : CanProtocol(processor)
 , _mutex(processor)
 {
-  processor->register_updater([this]()->bool { return on_update(); });
-  
-  processor->register_pgn_receiver(PGN_TP_CM, [this](const CanPacket& packet,const ConstantString& bus_name)
-  { on_pgn_callback(packet,bus_name); } );
+  processor->register_pgn_receiver(PGN_TP_CM, [this](const CanPacket& packet,CanBusHandle bus)
+  { on_pgn_callback(packet,bus); } );
 
-  processor->register_pgn_receiver(PGN_TP_DT, [this](const CanPacket& packet,const ConstantString& bus_name)
-  { on_pgn_callback(packet,bus_name); } );
+  processor->register_pgn_receiver(PGN_TP_DT, [this](const CanPacket& packet,CanBusHandle bus)
+  { on_pgn_callback(packet,bus); } );
+
+  processor->register_pgn_receiver(PGN_ETP_CM, [this](const CanPacket& packet,CanBusHandle bus)
+  { on_pgn_callback(packet,bus); } );
+
+  processor->register_pgn_receiver(PGN_ETP_DT, [this](const CanPacket& packet,CanBusHandle bus)
+  { on_pgn_callback(packet,bus); } );
 }
 
 /**
@@ -44,68 +48,172 @@ CanTransportProtocol::CanTransportProtocol(CanProcessor* processor)
  */
 CanTransportProtocol::~CanTransportProtocol()
 {
-  _session_stack[eTransmit]._session_queue.clear();
-  _session_stack[eReceive]._session_queue.clear();
+  _session_table[eTransmit].clear();
+  _session_table[eReceive].clear();
 }
 
 /**
  * \fn  CanTransportProtocol::send_message
  *
+ *  Messages above MAX_TP_DATA_SIZE go through ETP, which is destination
+ *  specific only. The local ECU needs an address on the bus, sessions
+ *  are keyed by it.
+ *
  * @param   message : const CanMessagePtr&
  * @param   local : const LocalECUPtr&
  * @param   remote : const RemoteECUPtr&
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @return  bool
  */
 bool CanTransportProtocol::send_message(const CanMessagePtr& message,const LocalECUPtr& local,
-                              const RemoteECUPtr& remote, const ConstantString& bus_name)
+                              const RemoteECUPtr& remote, CanBusHandle bus)
 {
-  if ((message->length() <= 8) || (message->length() > 1785))
+  if (message->length() <= 8)
     return false;
 
+  if ((message->length() > MAX_TP_DATA_SIZE) && 
+      (!remote || (message->length() > MAX_ETP_DATA_SIZE)))
+  {
+    return false;
+  }
+
+  uint8_t sa = local->get_address(bus);
+  uint8_t da = remote ? remote->get_address(bus) : BROADCAST_CAN_ADDRESS;
+  if ((sa >= NULL_CAN_ADDRESS) || (da == NULL_CAN_ADDRESS))
+    return false;
+
+  uint32_t key = SessionTable::key(bus, sa, da);
+  TransportSessionPtr session = TxSessionPtr(processor(), &_mutex, message, local, remote, bus);
+
   std::lock_guard<Mutex> lock(_mutex);
-  _session_stack[eTransmit].add(TxSessionPtr(processor(), &_mutex, message, local, remote, bus_name));
+  if (!_session_table[eTransmit].add(key, session))
+    return false;
+
+  if (_session_table[eTransmit].get_active(key) == session)
+    start(eTransmit, key, session);
+
   return true;
 }
 
 /**
- * \fn  CanTransportProtocol::on_update
+ * \fn  CanTransportProtocol::start
  *
- * @return  bool
+ *  Session got to the front of its queue, from now on its timer
+ *  drives it
+ *
+ * @param  direction : StackDirection
+ * @param  key : uint32_t
+ * @param  session : TransportSessionPtr
  */
-bool CanTransportProtocol::on_update()
+void CanTransportProtocol::start(StackDirection direction,uint32_t key,TransportSessionPtr session)
+{
+  while (session)
+  {
+    session->_timer = processor()->create_timer([this, direction, key, session]()
+    { on_timer(direction, key, session); });
+
+    if (session->_timer != CAN_INVALID_TIMER)
+    {
+      session->arm();
+      return;
+    }
+
+    session->abort(AbortScarseResources);
+    session = _session_table[direction].pop(key);
+  }
+}
+
+/**
+ * \fn  CanTransportProtocol::on_timer
+ *
+ * @param  direction : StackDirection
+ * @param  key : uint32_t
+ * @param  session : const TransportSessionPtr&
+ */
+void CanTransportProtocol::on_timer(StackDirection direction,uint32_t key,const TransportSessionPtr& session)
 {
   std::lock_guard<Mutex> lock(_mutex);
-  _session_stack[eTransmit].update();
-  _session_stack[eReceive].update();
-  return false;
+  if (_session_table[direction].get_active(key) != session)
+    return;
+
+  if (!session->is_complete())
+    session->update();
+
+  if (!session->is_complete())
+  {
+    session->arm();
+    return;
+  }
+
+  processor()->release_timer(session->_timer);
+  session->_timer = CAN_INVALID_TIMER;
+  start(direction, key, _session_table[direction].pop(key));
 }
 
 /**
  * \fn  CanTransportProtocol::on_pgn_callback
  *
  * @param   packet : const CanPacket&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
-void CanTransportProtocol::on_pgn_callback(const CanPacket& packet,const ConstantString& bus_name)
+void CanTransportProtocol::on_pgn_callback(const CanPacket& packet,CanBusHandle bus)
 {
   if (packet.dlc() < 8)
     return;
 
-  LocalECUPtr local(processor()->device_db().get_ecu_by_address(packet.da(),bus_name));
-  RemoteECUPtr remote(processor()->device_db().get_ecu_by_address(packet.sa(),bus_name));
+  LocalECUPtr local(processor()->device_db().get_ecu_by_address(packet.da(),bus));
+  RemoteECUPtr remote(processor()->device_db().get_ecu_by_address(packet.sa(),bus));
+
+  // Transmit sessions are keyed from our side, receive sessions
+  // from the sender's side
+  uint32_t tx_key = SessionTable::key(bus, packet.da(), packet.sa());
+  uint32_t rx_key = SessionTable::key(bus, packet.sa(), packet.da());
+
+  // TP and ETP share the session tables, a session only takes
+  // packets of its own protocol
+  bool extended = ((packet.pgn() == PGN_ETP_CM) || (packet.pgn() == PGN_ETP_DT));
+  auto active = [extended, tx_key, rx_key](SessionTable& table, bool transmit)->TransportSessionPtr
+  {
+    TransportSessionPtr session = table.get_active(transmit ? tx_key : rx_key);
+    if (session && (session->is_extended() != extended))
+      return TransportSessionPtr();
+    return session;
+  };
 
-  if (packet.pgn() == PGN_TP_CM)
+  if ((packet.pgn() == PGN_TP_CM) || (packet.pgn() == PGN_ETP_CM))
   {
     switch (packet.data()[0])
     {
     case CTS:
     case EOM:
+    case ETP_CTS:
+    case ETP_EOM:
       {
         std::lock_guard<Mutex> lock(_mutex);
-        TransportSessionPtr session = _session_stack[eTransmit].get_active(local, remote, bus_name);
+        TransportSessionPtr session = active(_session_table[eTransmit], true);
         if (session)
+        {
           session->pgn_received(packet);
+          session->arm();
+        }
+      }
+      break;
+
+    case ETP_DPO:
+      {
+        TransportSessionPtr received;
+        {
+          std::lock_guard<Mutex> lock(_mutex);
+          TransportSessionPtr session = active(_session_table[eReceive], false);
+          if (session)
+          {
+            session->pgn_received(packet);
+            if (session->take_received())
+              received = session;
+            session->arm();
+          }
+        }
+        deliver(received);
       }
       break;
 
@@ -116,17 +224,23 @@ void CanTransportProtocol::on_pgn_callback(const CanPacket& packet,const Constan
       case AbortTimeout:
         {
           std::lock_guard<Mutex> lock(_mutex);
-          TransportSessionPtr session = _session_stack[eTransmit].get_active(local, remote, bus_name);
+          TransportSessionPtr session = active(_session_table[eTransmit], true);
           if (session)
+          {
             session->abort(AbortIgnoreMessage);
+            session->arm();
+          }
         }
         break;
       default:
         {
           std::lock_guard<Mutex> lock(_mutex);
-          TransportSessionPtr session = _session_stack[eReceive].get_active(remote, local, bus_name);
+          TransportSessionPtr session = active(_session_table[eReceive], false);
           if (session)
+          {
             session->abort(AbortIgnoreMessage);
+            session->arm();
+          }
         }
         break;
       }
@@ -135,13 +249,20 @@ void CanTransportProtocol::on_pgn_callback(const CanPacket& packet,const Constan
 
     case RTS:
     case BAM:
+    case ETP_RTS:
       {
+        // ETP has no broadcast, ETP_RTS is the only ETP session opener
+        if (extended != (packet.data()[0] == ETP_RTS))
+          break;
+
         std::lock_guard<Mutex> lock(_mutex);
-        TransportSessionPtr session = _session_stack[eReceive].get_active(remote, local, bus_name);
+        TransportSessionPtr session = _session_table[eReceive].get_active(rx_key);
         if (session)
           // Ignoring this session
           break;
-        _session_stack[eReceive].add(RxSessionPtr(processor(), &_mutex, remote, local, bus_name, packet));
+        session = RxSessionPtr(processor(), &_mutex, remote, local, bus, packet);
+        if (_session_table[eReceive].add(rx_key, session))
+          start(eReceive, rx_key, session);
       }
       break;
 
@@ -149,16 +270,122 @@ void CanTransportProtocol::on_pgn_callback(const CanPacket& packet,const Constan
       break;
     }
   }
-  else if (packet.pgn() == PGN_TP_DT)
+  else if ((packet.pgn() == PGN_TP_DT) || (packet.pgn() == PGN_ETP_DT))
   {
-    std::lock_guard<Mutex> lock(_mutex);
-    TransportSessionPtr session = _session_stack[eReceive].get_active(remote, local, bus_name);
-    if (session)
-      session->pgn_received(packet);
+    TransportSessionPtr received;
+    {
+      std::lock_guard<Mutex> lock(_mutex);
+      TransportSessionPtr session = active(_session_table[eReceive], false);
+      if (session)
+      {
+        session->pgn_received(packet);
+        if (session->take_received())
+          received = session;
+        session->arm();
+      }
+    }
+    deliver(received);
   }
 }
 
-} // can
-} // brt
+/**
+ * \fn  CanTransportProtocol::deliver
+ *
+ *  Hands a completed message to the application. Called with no lock
+ *  held, a slow callback must not stall the sessions of other buses
+ *
+ * @param  session : const TransportSessionPtr&
+ */
+void CanTransportProtocol::deliver(const TransportSessionPtr& session)
+{
+  if (session)
+    processor()->message_received(session->message(), session->local(), session->remote(), session->bus());
+}
+
+/**
+ * \fn  CanTransportProtocol::SessionTable::add
+ *
+ *  Queues session behind the sessions already open for key
+ *
+ * @param  key : uint32_t
+ * @param  session : const TransportSessionPtr&
+ * @return  bool, false if the table is full
+ */
+bool CanTransportProtocol::SessionTable::add(uint32_t key,const TransportSessionPtr& session)
+{
+  Queue* queue = _queues.find(key);
+  if (queue != nullptr)
+  {
+    queue->_tail->_next = session;
+    queue->_tail = session;
+    return true;
+  }
+
+  queue = _queues.insert(key);
+  if (queue == nullptr)
+    return false;
+
+  queue->_head = session;
+  queue->_tail = session;
+  return true;
+}
+
+/**
+ * \fn  CanTransportProtocol::SessionTable::pop
+ *
+ *  Drops the front session of key
+ *
+ * @param  key : uint32_t
+ * @return  TransportSessionPtr the new front session
+ */
+TransportSessionPtr CanTransportProtocol::SessionTable::pop(uint32_t key)
+{
+  Queue* queue = _queues.find(key);
+  if (queue == nullptr)
+    return TransportSessionPtr();
 
+  TransportSessionPtr next = queue->_head->_next;
+  queue->_head->_next.reset();
+  queue->_head = next;
+
+  if (!queue->_head)
+    _queues.erase(key);
+
+  return next;
+}
 
+/**
+ * \fn  CanTransportProtocol::SessionTable::get_active
+ *
+ * @param  key : uint32_t
+ * @return  TransportSessionPtr
+ */
+TransportSessionPtr CanTransportProtocol::SessionTable::get_active(uint32_t key) const
+{
+  const Queue* queue = _queues.find(key);
+  if (queue == nullptr)
+    return TransportSessionPtr();
+
+  return queue->_head;
+}
+
+/**
+ * \fn  CanTransportProtocol::SessionTable::clear
+ *
+ */
+void CanTransportProtocol::SessionTable::clear()
+{
+  _queues.for_each([](uint32_t,Queue& queue)
+  {
+    for (TransportSessionPtr session = queue._head; session; )
+    {
+      TransportSessionPtr next = session->_next;
+      session->_next.reset();
+      session = next;
+    }
+  });
+  _queues.clear();
+}
+
+} // can
+} // brt
@@ -14,8 +14,7 @@
 #include "can_transport_session.hpp"
 #include "can_transport_defines.hpp"
 
-#include <unordered_set>
-#include <deque>
+#include <array>
 #include <memory>
 
 
@@ -35,17 +34,13 @@ public:
   virtual ~CanTransportProtocol();
 
   virtual bool                    send_message(const CanMessagePtr& message,const LocalECUPtr& local,
-                                            const RemoteECUPtr& remote, const ConstantString& bus_name);
+                                            const RemoteECUPtr& remote, CanBusHandle bus);
 
 private:
-          bool                    on_update();
-          void                    on_pgn_callback(const CanPacket&,const ConstantString&);
+          void                    on_pgn_callback(const CanPacket&,CanBusHandle);
+          void                    deliver(const TransportSessionPtr& session);
 
 private:
-  typedef fifo<TransportSessionPtr,64>    SessionQueue;
-  typedef std::pair<size_t,SessionQueue>  HashPair;
-  typedef fixed_list<HashPair,32>         SessionMap;
-  
   enum StackDirection
   {
     eTransmit = 0,
@@ -55,75 +50,40 @@ private:
   };
 
   /**
-   * \struct SessonStack
+   * \class SessionTable
    *
+   *  Open addressing table of session queues keyed by bus, source and
+   *  destination address. Only the front session of a queue is
+   *  serviced, sessions of different keys progress independently.
    */
-  struct SessonStack
+  class SessionTable
   {
-    /**
-     * \fn  add
-     *
-     * @param  session : TransportSessionPtr
-     */
-    void add(TransportSessionPtr session)
-    {
-      size_t hash = TransportSession::hash(session);
-      auto iter = _session_queue.find_if([hash](const HashPair& pair)->bool
-      {
-        return pair.first == hash;
-      });
-
-      if (iter == _session_queue.end())
-        iter = _session_queue.push(HashPair(hash,SessionQueue()));
+  public:
+    static  uint32_t              key(CanBusHandle bus,uint8_t sa,uint8_t da)
+    { return 0x80000000 | ((bus & 0x7FFF) << 16) | (sa << 8) | da; }
 
-      if (iter != _session_queue.end())
-        iter->second.push(session);
-    }
+            bool                  add(uint32_t key,const TransportSessionPtr& session);
+            TransportSessionPtr   pop(uint32_t key);
+            TransportSessionPtr   get_active(uint32_t key) const;
+            void                  clear();
 
+  private:
     /**
-     * \fn  update
+     * \struct Queue
      *
-     * @param removed : std::vector<size_t>&
      */
-    void update()
+    struct Queue
     {
-      for (auto iter = _session_queue.begin(); iter != _session_queue.end(); )
-      {
-        iter->second.front()->update();
-        if (iter->second.front()->is_complete())
-          iter->second.pop();
-
-        if (iter->second.empty())
-          iter = _session_queue.erase(iter);
-        else
-          iter++;
-      }
-    }
+      TransportSessionPtr         _head;
+      TransportSessionPtr         _tail;
+    };
 
-    /**
-     * \fn  get_active
-     *
-     * @param  source : CanECUPtr 
-     * @param  destination :  CanECUPtr 
-     * @param  bus_name :  const std::string&
-     * @return  TransportSessionPtr
-     */
-    TransportSessionPtr get_active(const CanECUPtr& source,const CanECUPtr& destination, const ConstantString& bus_name)
-    {
-      size_t hash = TransportSession::hash(source, destination, bus_name);
-      auto iter = _session_queue.find_if([hash](const HashPair& pair)->bool
-      {
-        return pair.first == hash;
-      });
-
-      if (iter == _session_queue.end())
-        return TransportSessionPtr();
-
-      return iter->second.front();
-    }
-    
-    SessionMap                    _session_queue;
-  }                               _session_stack[eNumDirections];
+    // Keys are never 0, which marks a free slot
+    open_table<uint32_t,Queue,TRANSPORT_SESSION_SLOTS_BITS> _queues;
+  }                               _session_table[eNumDirections];
+
+          void                    start(StackDirection direction,uint32_t key,TransportSessionPtr session);
+          void                    on_timer(StackDirection direction,uint32_t key,const TransportSessionPtr& session);
 
   RecursiveMutex                 _mutex;
 };
@@ -18,31 +18,64 @@ allocator<RxSession>* RxSession::_allocator = nullptr;
  * @param  mutex :  Mutex* 
  * @param   source : const CanECUPtr&
  * @param   destination : const CanECUPtr&
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param   packet :  const CanPacket&
  */
 RxSession::RxSession(CanProcessor* processor, Mutex* mutex,const CanECUPtr& source,const CanECUPtr& destination,
-                              const ConstantString& bus_name, const CanPacket& packet)
-: TransportSession(processor, mutex, CanMessagePtr(), source, destination, bus_name)
+                              CanBusHandle bus, const CanPacket& packet)
+: TransportSession(processor, mutex, CanMessagePtr(), source, destination, bus)
+, _packet_offset(0)
+, _max_packets(0)
+, _window(0)
+, _cts_time(0)
 , _range()
 , _current(0)
 , _time_tag(processor->get_time_tick())
 , _timeout_value(TRANSPORT_TIMEOUT_T2)
 , _attempts(0)
 , _complete(false)
+, _delivery_pending(false)
 {
+  _extended = (packet.pgn() == PGN_ETP_CM);
+
   uint32_t pgn  = packet.data()[5] | (packet.data()[6] << 8) | (packet.data()[7] << 16);
   uint32_t size = packet.data()[1] | (packet.data()[2] << 8);
-  _message = CanMessagePtr(size, pgn);
+  if (is_extended())
+    size |= (packet.data()[3] << 16) | (packet.data()[4] << 24);
+
+  _received_map.reset();
+
+  uint8_t reason = 0;
+  if ((size == 0) || (size > (is_extended() ? MAX_ETP_DATA_SIZE : MAX_TP_DATA_SIZE)))
+    reason = AbortSizeToBig;
+  else
+  {
+    // Reassembly goes straight into application memory when
+    // the provider has a buffer for this message. The heap is only
+    // used up to the configured limit, the size is chosen by the peer
+    CanBufferProvider* provider = processor->rx_buffer_provider();
+    uint8_t* data = (provider != nullptr) ? provider->acquire(pgn, size, bus) : nullptr;
+    if (data != nullptr)
+      _message = CanMessagePtr(CanBuffer(data, size, provider), pgn);
+    else if (size <= can_library_config()._rx_heap_message_limit)
+      _message = CanMessagePtr(size, pgn);
+    else
+      reason = AbortScarseResources;
+  }
 
-  _max_packets = packet.data()[4];
+  if (reason != 0)
+  {
+    // abort() needs the PGN of the rejected message
+    _message = CanMessagePtr(static_cast<uint32_t>(0), pgn);
+    abort(reason);
+    return;
+  }
+
+  _max_packets = is_extended() ? 0xFF : packet.data()[4];
   if (_max_packets == 0xFF)
-    _max_packets = static_cast<uint8_t>((size - 1) / 7 + 1);
-  
-  _received_map.fill(false);
+    _max_packets = static_cast<uint8_t>(std::min(num_sequences(), static_cast<size_t>(MAX_TP_PACKETS)));
 
-  if (size > MAX_TP_DATA_SIZE)
-    abort(AbortSizeToBig);
+  _window = std::min(_max_packets, static_cast<uint8_t>(CTS_ADAPTIVE_INITIAL_WINDOW));
 
   if (!is_broadcast())
     send_cts();
@@ -64,6 +97,7 @@ void RxSession::update()
       abort(AbortMaxTxRequestLimit);
     else
     {
+      shrink_window();
       send_cts();
       _time_tag = processor()->get_time_tick();
       _timeout_value = TRANSPORT_TIMEOUT_T2;
@@ -78,25 +112,37 @@ void RxSession::update()
  */
 void RxSession::pgn_received(const CanPacket& packet)
 {
-  uint8_t sequence_number = packet.data()[0];
-  uint8_t data_bytes[7];
-  memcpy(data_bytes, &packet.data()[1], 7);
+  if (packet.pgn() == PGN_ETP_CM)
+  {
+    if (packet.data()[0] == ETP_DPO)
+      on_dpo(packet);
+    return;
+  }
 
   _timeout_value = TRANSPORT_TIMEOUT_T1;
 
-  if (sequence_received(sequence_number, data_bytes))
+  if (sequence_received(packet.data()[0], &packet.data()[1]))
   {
-    if (is_range_complete(range(0,num_sequences()))) 
+    if (is_message_complete()) 
     {
       if (!is_broadcast())
         send_eom();
 
       message_complete();
     }
-    else 
+    else if (!is_broadcast())
     {
-      if (!is_broadcast() && is_range_complete(_range))
+      if (is_range_complete(_range))
+      {
+        grow_window();
+        send_cts();
+        _timeout_value = TRANSPORT_TIMEOUT_T2;
+      }
+      else if ((packet.data()[0] - 1) >= (_range.second - 1))
       {
+        // Last packet of the window is in but some before it got
+        // lost, request the gaps right away instead of waiting for T1
+        shrink_window();
         send_cts();
         _timeout_value = TRANSPORT_TIMEOUT_T2;
       }
@@ -106,6 +152,33 @@ void RxSession::pgn_received(const CanPacket& packet)
   _time_tag = processor()->get_time_tick();
 }
 
+/**
+ * \fn  RxSession::on_dpo
+ *
+ *  ETP Data Packet Offset opens the window the next DT sequences refer to
+ *
+ * @param  packet : const CanPacket& 
+ */
+void RxSession::on_dpo(const CanPacket& packet)
+{
+  uint32_t offset = packet.data()[2] | (packet.data()[3] << 8) | (packet.data()[4] << 16);
+  uint8_t  count  = packet.data()[1];
+
+  if ((count == 0) || (offset >= num_sequences()))
+  {
+    abort(AbortBadSequenceNumber);
+    return;
+  }
+
+  _packet_offset = offset;
+  _range.first = 0;
+  _range.second = static_cast<uint8_t>(std::min(static_cast<size_t>(count), num_sequences() - offset));
+  _received_map.reset();
+
+  _timeout_value = TRANSPORT_TIMEOUT_T1;
+  _time_tag = processor()->get_time_tick();
+}
+
 /**
  * \fn  RxSession::sequence_received
  *
@@ -115,22 +188,27 @@ void RxSession::pgn_received(const CanPacket& packet)
  */
 bool RxSession::sequence_received(uint8_t sequence, const uint8_t bytes[7])
 {
-  uint32_t offset = (sequence - 1) * 7;
+  if (sequence == 0)
+  {
+    abort(AbortBadSequenceNumber);
+    return false;
+  }
+
+  size_t offset = (static_cast<size_t>(_packet_offset) + sequence - 1) * 7;
   if (offset >= _message->length())
   {
     abort(AbortBadSequenceNumber);
     return false;
   }
 
-  if (_received_map[sequence])
+  if (_received_map.test_and_set(sequence - 1))
   {
     abort(AbortDupSequenceNumber);
     return false;
   }
 
-  size_t num_bytes = std::min(_message->length() - offset, 7u);
+  size_t num_bytes = std::min(_message->length() - offset, static_cast<size_t>(7));
   memcpy(_message->data() + offset, bytes, num_bytes);
-  _received_map[sequence - 1] = true;
   return true;
 }
 
@@ -143,12 +221,20 @@ bool RxSession::sequence_received(uint8_t sequence, const uint8_t bytes[7])
  */
 bool RxSession::is_range_complete(const range& range) const
 {
-  for (size_t index = range.first; index < range.second; index++)
-  {
-    if (!_received_map[index])
-      return false;
-  }
-  return true;
+  return _received_map.all(range.first, range.second);
+}
+
+/**
+ * \fn  RxSession::is_message_complete
+ *
+ * @return  bool
+ */
+bool RxSession::is_message_complete() const
+{
+  if (!is_extended())
+    return is_range_complete(range(0,num_sequences()));
+
+  return ((_packet_offset + _range.second) >= num_sequences()) && is_range_complete(_range);
 }
 
 /**
@@ -158,24 +244,50 @@ bool RxSession::is_range_complete(const range& range) const
  */
 bool RxSession::send_cts()
 {
-  uint8_t starting_sequence = 255;
-  uint8_t num_sequences = static_cast<uint8_t>((_message->length() - 1) / 7 + 1);
+  size_t window = is_extended() ? _range.second : num_sequences();
+  size_t starting_sequence = _received_map.find_first_zero(0, window);
+
+  // Only the missing run is requested, the packets after it
+  // have already arrived
+  size_t missing = _received_map.find_first_set(starting_sequence, window) - starting_sequence;
+  _cts_time = processor()->get_time_tick();
 
-  for (size_t index = 0; ((index < num_sequences) && (starting_sequence == 255)); index++)
+  uint32_t pgn = message()->pgn();
+  if (is_extended())
   {
-    if (!_received_map[index])
-      starting_sequence = index;
+    // Next packet is absolute in ETP, the following DPO rebases the window
+    uint32_t next_packet = _packet_offset + static_cast<uint32_t>(starting_sequence);
+    if (next_packet >= num_sequences())
+      return false;
+
+    if (starting_sequence + missing >= window)
+      missing = num_sequences() - next_packet;
+
+    uint8_t max_packets = static_cast<uint8_t>(std::min(missing, window_size()));
+    next_packet++;
+
+    CanMessagePtr msg(
+    {
+      static_cast<uint8_t>(ETP_CTS), 
+      max_packets,
+      static_cast<uint8_t>(next_packet & 0xFF),
+      static_cast<uint8_t>((next_packet >> 8) & 0xFF),
+      static_cast<uint8_t>((next_packet >> 16) & 0xFF),
+      static_cast<uint8_t>(pgn & 0xFF),
+      static_cast<uint8_t>((pgn >> 8) & 0xFF),
+      static_cast<uint8_t>((pgn >> 16) & 0xFF),
+    }, PGN_ETP_CM, 7);
+
+    return processor()->send_can_message(msg, local(), remote(), bus());
   }
 
-  if (starting_sequence == 255)
+  if (starting_sequence >= num_sequences())
     return false;
 
-  uint8_t max_packets = std::min(static_cast<uint8_t>(num_sequences - starting_sequence),_max_packets);
+  uint8_t max_packets = static_cast<uint8_t>(std::min(missing, window_size()));
   
-  _range.first = starting_sequence;
-  _range.second = starting_sequence + max_packets;
-  if (_range.second > num_sequences)
-    _range.second = num_sequences;
+  _range.first = static_cast<uint8_t>(starting_sequence);
+  _range.second = static_cast<uint8_t>(starting_sequence + max_packets);
 
   CanMessagePtr msg(
   {
@@ -183,12 +295,52 @@ bool RxSession::send_cts()
     max_packets,
     static_cast<uint8_t>(starting_sequence + 1),
     0xFF, 0xFF,
-    static_cast<uint8_t>(message()->pgn() & 0xFF),
-    static_cast<uint8_t>((message()->pgn() >> 8) & 0xFF),
-    static_cast<uint8_t>((message()->pgn() >> 16) & 0xFF),
+    static_cast<uint8_t>(pgn & 0xFF),
+    static_cast<uint8_t>((pgn >> 8) & 0xFF),
+    static_cast<uint8_t>((pgn >> 16) & 0xFF),
   }, PGN_TP_CM, 7);
   
-  return processor()->send_can_message(msg, local(), remote(), { bus_name() });
+  return processor()->send_can_message(msg, local(), remote(), bus());
+}
+
+/**
+ * \fn  RxSession::window_size
+ *
+ * @return  size_t number of packets the next CTS may grant
+ */
+size_t RxSession::window_size() const
+{
+  return can_library_config()._adaptive_cts_window ? _window : _max_packets;
+}
+
+/**
+ * \fn  RxSession::grow_window
+ *
+ *  The last window arrived complete. One that came in at close to bus
+ *  speed doubles the next one, a slow one only adds a packet.
+ */
+void RxSession::grow_window()
+{
+  size_t count = _range.second - _range.first;
+  uint64_t elapsed = processor()->get_time_tick() - _cts_time;
+
+  size_t window = _window;
+  if (elapsed <= (count * CTS_ADAPTIVE_FAST_PACKET_TIME))
+    window *= 2;
+  else
+    window++;
+
+  _window = static_cast<uint8_t>(std::min(window, static_cast<size_t>(_max_packets)));
+}
+
+/**
+ * \fn  RxSession::shrink_window
+ *
+ *  Packets got lost or the sender stalled
+ */
+void RxSession::shrink_window()
+{
+  _window = std::max<uint8_t>(_window / 2, 1);
 }
 
 /**
@@ -199,34 +351,47 @@ bool RxSession::send_cts()
 bool RxSession::send_eom()
 {
   uint32_t total_size = message()->length();
-  uint8_t num_packets = static_cast<uint8_t>((total_size - 1) / 7 + 1);
+  uint32_t pgn = message()->pgn();
 
   CanMessagePtr msg(
     {
-      static_cast<uint8_t>(EOM), 
+      static_cast<uint8_t>(is_extended() ? ETP_EOM : EOM), 
       static_cast<uint8_t>(total_size & 0xFF),
       static_cast<uint8_t>((total_size >> 8) & 0xFF),
-      num_packets,
-      0xFF,
-      static_cast<uint8_t>(message()->pgn() & 0xFF),
-      static_cast<uint8_t>((message()->pgn() >> 8) & 0xFF),
-      static_cast<uint8_t>((message()->pgn() >> 16) & 0xFF),
-    }, PGN_TP_CM, 7);
-
-  
-  return processor()->send_can_message(msg, local(), remote(), { bus_name()});
+      static_cast<uint8_t>(is_extended() ? ((total_size >> 16) & 0xFF) : num_sequences()),
+      static_cast<uint8_t>(is_extended() ? ((total_size >> 24) & 0xFF) : 0xFF),
+      static_cast<uint8_t>(pgn & 0xFF),
+      static_cast<uint8_t>((pgn >> 8) & 0xFF),
+      static_cast<uint8_t>((pgn >> 16) & 0xFF),
+    }, cm_pgn(), 7);
+
+  return processor()->send_can_message(msg, local(), remote(), bus());
 }
 
 /**
  * \fn  RxSession::message_complete
  *
+ *  Runs under the transport lock, the message is handed to the
+ *  application by CanTransportProtocol after the lock is released
  */
 void RxSession::message_complete()
 {
-  processor()->message_received(message(), local(), remote(), bus_name());
+  _delivery_pending = true;
   _complete = true;
 }
 
+/**
+ * \fn  RxSession::take_received
+ *
+ * @return  bool
+ */
+bool RxSession::take_received()
+{
+  bool result = _delivery_pending;
+  _delivery_pending = false;
+  return result;
+}
+
 /**
  * \fn  delete
  *
@@ -249,11 +414,11 @@ void RxSession::operator delete  ( void* ptr )
  * @param  mutex :  Mutex* 
  * @param  source :  const CanECUPtr&
  * @param  destination : const CanECUPtr&
- * @param   bus_name :  const ConstantString&
+ * @param   bus :  CanBusHandle
  * @param   packet :  const CanPacket&
  */
 RxSessionPtr::RxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanECUPtr& source, const CanECUPtr& destination,
-                              const ConstantString& bus_name, const CanPacket& packet)
+                              CanBusHandle bus, const CanPacket& packet)
 {
   if (RxSession::_allocator == nullptr)
     throw std::runtime_error("Library is not properly initialized");
@@ -262,7 +427,7 @@ RxSessionPtr::RxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanECUPt
   if (session == nullptr)
     session = reinterpret_cast<RxSession*>(::malloc(sizeof(RxSession)));
 
-  ::new (session) RxSession(processor, mutex, source, destination, bus_name, packet);
+  ::new (session) RxSession(processor, mutex, source, destination, bus, packet);
   reset(session);
 }
 
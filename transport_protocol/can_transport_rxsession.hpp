@@ -24,7 +24,7 @@ friend bool can_library_init(const LibraryConfig&);
 friend bool can_library_release();
 
   RxSession(CanProcessor* processor, Mutex* mutex,const CanECUPtr& source,const CanECUPtr& destination,
-                              const ConstantString& bus_name, const CanPacket& packet);
+                              CanBusHandle bus, const CanPacket& packet);
 
 public:
   virtual ~RxSession() {}
@@ -36,13 +36,20 @@ public:
   virtual void                    pgn_received(const CanPacket& packet);
   virtual bool                    is_complete() const {return _complete; }
   virtual void                    on_abort() { _complete = true; }
+  virtual uint64_t                deadline() const { return _complete ? 0 : (_time_tag + _timeout_value + 1); }
+  virtual bool                    take_received();
 
           size_t                  num_sequences() const { return  (message()->length() - 1) / 7 + 1; }
           bool                    sequence_received(uint8_t sequence, const uint8_t[7]);
           bool                    is_range_complete(const range& range) const;
+          bool                    is_message_complete() const;
           
           bool                    send_cts();
+          size_t                  window_size() const;
+          void                    grow_window();
+          void                    shrink_window();
           bool                    send_eom();
+          void                    on_dpo(const CanPacket& packet);
                     
           void                    message_complete();
 
@@ -51,8 +58,14 @@ public:
 private:
   static allocator<RxSession>*    _allocator;
 
-  std::array<bool,MAX_TP_PACKETS> _received_map;
+  // Indexed relative to _packet_offset. TP keeps the offset at 0,
+  // ETP moves it with every Data Packet Offset
+  bit_map<256>                    _received_map;
+  uint32_t                        _packet_offset;
   uint8_t                         _max_packets;
+  // Current CTS window in adaptive mode, never above _max_packets
+  uint8_t                         _window;
+  uint64_t                        _cts_time;
 
   range                           _range;
   uint32_t                        _current;
@@ -61,6 +74,7 @@ private:
   int                             _attempts;
 
   bool                            _complete;
+  bool                            _delivery_pending;
 };
 
 /**
@@ -75,7 +89,7 @@ class RxSessionPtr : public shared_pointer<RxSession>
 public:
   RxSessionPtr() {}
   RxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanECUPtr& source,const CanECUPtr& destination,
-                              const ConstantString& bus_name, const CanPacket& packet);
+                              CanBusHandle bus, const CanPacket& packet);
 };
 
 
@@ -30,14 +30,26 @@ void TransportSession::abort(uint8_t reason)
         static_cast<uint8_t>(_message->pgn() & 0xFF),
         static_cast<uint8_t>((_message->pgn() >> 8) & 0xFF),
         static_cast<uint8_t>((_message->pgn() >> 16) & 0xFF),
-      }, PGN_TP_CM, 7);
+      }, cm_pgn(), 7);
 
-    _processor->send_can_message(msg, local(), remote(), { _bus_name });
+    _processor->send_can_message(msg, local(), remote(), _bus);
   }
   on_abort();
 }
 
 
+/**
+ * \fn  TransportSession::arm
+ *
+ *  Moves the session timer to the current deadline, to be called
+ *  whenever the session state changes outside of update()
+ */
+void TransportSession::arm()
+{
+  if (_timer != CAN_INVALID_TIMER)
+    _processor->schedule_timer(_timer, deadline());
+}
+
 } // can
 } // brt
 
@@ -12,6 +12,7 @@
 #include "local_ecu.hpp"
 #include "remote_ecu.hpp"
 #include "can_message.hpp"
+#include "can_timers.hpp"
 
 #include "can_transport_defines.hpp"
 
@@ -36,11 +37,13 @@ public:
    * @param   message :  const CanMessagePtr&
    * @param   local :  const CanECUPtr&
    * @param   remote : const CanECUPtr&
-   * @param   bus_name : const ConstantString&
+   * @param   bus : CanBusHandle
    */
   TransportSession(CanProcessor* processor, Mutex* mutex, const CanMessagePtr& message,
-                            const CanECUPtr& local,const CanECUPtr& remote,const ConstantString& bus_name)
-  : _processor(processor), _mutex(mutex), _message(message), _source(local), _destination(remote), _bus_name(bus_name)
+                            const CanECUPtr& local,const CanECUPtr& remote,CanBusHandle bus)
+  : _timer(CAN_INVALID_TIMER)
+  , _processor(processor), _mutex(mutex), _message(message), _source(local), _destination(remote), _bus(bus)
+  , _extended(false)
   { 
   }
 
@@ -57,13 +60,20 @@ public:
           CanProcessor*           processor() { return _processor; }
           CanECUPtr               source_ecu() const { return _source; }
           CanECUPtr               destination_ecu() const { return _destination; }
-          const CanString&        bus_name() const { return _bus_name; }
+          CanBusHandle            bus() const { return _bus; }
           bool                    is_broadcast() const { return !_destination; }
+
+          // Extended transport protocol (ETP) session, payload above MAX_TP_DATA_SIZE
+          bool                    is_extended() const { return _extended; }
+          uint32_t                cm_pgn() const { return _extended ? PGN_ETP_CM : PGN_TP_CM; }
+          uint32_t                dt_pgn() const { return _extended ? PGN_ETP_DT : PGN_TP_DT; }
           
   virtual void                    update() = 0;
   virtual void                    pgn_received(const CanPacket& packet) = 0;
   virtual bool                    is_complete() const = 0;
   virtual void                    on_abort() = 0;
+  // Time tick at which update() has work to do
+  virtual uint64_t                deadline() const = 0;
 
           void                    abort(uint8_t reason);
           CanMessagePtr           message() const { return _message; }
@@ -71,23 +81,19 @@ public:
   virtual LocalECUPtr             local() = 0;
   virtual RemoteECUPtr            remote() = 0;
 
+  // True once for a completed receive whose message still has to be
+  // handed to the application, outside of the transport lock
+  virtual bool                    take_received() { return false; }
 
-  static  size_t                  hash(const CanECUPtr& local,const CanECUPtr& remote,const ConstantString& bus_name)
-  {
-    size_t hash = std::hash<CanECU*>()(local.get());
-    if (remote)
-      hash ^= std::hash<CanECU*>()(remote.get());
-    else
-      hash ^= std::hash<uint32_t>()(0xFFFFFFFF);
-            
-    hash ^= std::hash<std::string_view>()(std::string_view(bus_name.data(), bus_name.length()));
-    return hash;
-  }
+protected:
+          void                    arm();
 
-  static  size_t                  hash(const shared_pointer<TransportSession>& session)
-  {
-    return hash(session->_source, session->_destination, session->_bus_name);
-  }
+private:
+friend class CanTransportProtocol;
+  // Next session queued on the same CanTransportProtocol session table slot
+  shared_pointer<TransportSession> _next;
+  // Processor timer, allocated while the session is at the front of its queue
+  uint32_t                        _timer;
 
 protected:
   CanProcessor*                   _processor;
@@ -96,7 +102,8 @@ protected:
   CanMessagePtr                   _message;
   CanECUPtr                       _source;
   CanECUPtr                       _destination;
-  CanString                       _bus_name;
+  CanBusHandle                    _bus;
+  bool                            _extended;
 };
 
 typedef shared_pointer<TransportSession> TransportSessionPtr;
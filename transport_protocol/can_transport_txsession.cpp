@@ -7,6 +7,7 @@
 #include "../can_processor.hpp"
 
 #include <mutex>
+#include <string.h>
 
 namespace brt {
 namespace can {
@@ -37,32 +38,30 @@ bool TxSession::send_bam(CanMessage::ConfirmationCallback cback
       static_cast<uint8_t>((message()->pgn() >> 16) & 0xFF),
     }, PGN_TP_CM, 7, cback);
 
-  return processor()->send_can_message(msg, local(), RemoteECUPtr(),{ bus_name() });
+  return processor()->send_can_message(msg, local(), RemoteECUPtr(), bus());
 }
 
 /**
- * \fn  TxSession::send_data
+ * \fn  TxSession::data_packet
  *
- * @param  sequence : uint8_t 
- * @param   cback :  CanMessage::ConfirmationCallback
- * @return  bool
+ *  DT frame straight from the message buffer with the cached
+ *  identifier. ETP sequence numbers are relative to the last data
+ *  packet offset
+ *
+ * @param  packet : uint32_t zero based packet index in the message
+ * @return  CanPacket
  */
-bool TxSession::send_data(uint8_t sequence, CanMessage::ConfirmationCallback cback 
-                            /*= CanMessage::ConfirmationCallback()*/)
+CanPacket TxSession::data_packet(uint32_t packet) const
 {
-  uint32_t offset = (sequence * 7);
-  if (offset >= message()->length())
-    return false;
-
+  uint32_t offset = (packet * 7);
   uint32_t num_bytes = std::min(message()->length() - offset, 7U);
-  std::array<uint8_t,8> data;
-  data.fill(0xFF);
-  
-  data[0] = (sequence + 1);
+
+  uint8_t data[8];
+  data[0] = static_cast<uint8_t>(is_extended() ? (packet - _dpo_offset + 1) : (packet + 1));
   memcpy(&data[1], &message()->data()[offset], num_bytes);
+  memset(&data[1 + num_bytes], 0xFF, 7 - num_bytes);
 
-  CanMessagePtr msg(data.data(), data.size(),  PGN_TP_DT, 7, cback);
-  return processor()->send_can_message(msg, local(), remote(), { bus_name() });
+  return CanPacket(_dt_id, data, sizeof(data));
 }
 
 /**
@@ -74,22 +73,259 @@ bool TxSession::send_data(uint8_t sequence, CanMessage::ConfirmationCallback cba
 bool TxSession::send_rts( CanMessage::ConfirmationCallback cback 
                   /*= CanMessage::ConfirmationCallback()*/)
 {
-  uint16_t total_size = static_cast<uint16_t>(message()->length());
-  uint8_t  num_packets = static_cast<uint8_t>((total_size - 1) / 7 + 1);
+  uint32_t total_size = message()->length();
+  uint32_t pgn = message()->pgn();
+
+  if (is_extended())
+  {
+    CanMessagePtr msg(
+      {
+        static_cast<uint8_t>(ETP_RTS), 
+        static_cast<uint8_t>(total_size & 0xFF),
+        static_cast<uint8_t>((total_size >> 8) & 0xFF),
+        static_cast<uint8_t>((total_size >> 16) & 0xFF),
+        static_cast<uint8_t>((total_size >> 24) & 0xFF),
+        static_cast<uint8_t>(pgn & 0xFF),
+        static_cast<uint8_t>((pgn >> 8) & 0xFF),
+        static_cast<uint8_t>((pgn >> 16) & 0xFF),
+      }, PGN_ETP_CM, 7, cback);
+
+    return processor()->send_can_message(msg, local(), remote(), bus());
+  }
 
   CanMessagePtr msg(
     {
       static_cast<uint8_t>(RTS), 
       static_cast<uint8_t>(total_size & 0xFF),
       static_cast<uint8_t>((total_size >> 8) & 0xFF),
-      num_packets,
+      static_cast<uint8_t>(num_packets()),
       0xFF,
-      static_cast<uint8_t>(message()->pgn() & 0xFF),
-      static_cast<uint8_t>((message()->pgn() >> 8) & 0xFF),
-      static_cast<uint8_t>((message()->pgn() >> 16) & 0xFF),
+      static_cast<uint8_t>(pgn & 0xFF),
+      static_cast<uint8_t>((pgn >> 8) & 0xFF),
+      static_cast<uint8_t>((pgn >> 16) & 0xFF),
     }, PGN_TP_CM, 7, cback);
 
-  return processor()->send_can_message(msg, local(), remote(), { bus_name() });
+  return processor()->send_can_message(msg, local(), remote(), bus());
+}
+
+/**
+ * \fn  TxSession::send_dpo
+ *
+ *  ETP Data Packet Offset for the window granted by the last CTS
+ *
+ * @param   cback : CanMessage::ConfirmationCallback
+ * @return  bool
+ */
+bool TxSession::send_dpo( CanMessage::ConfirmationCallback cback 
+                  /*= CanMessage::ConfirmationCallback()*/)
+{
+  uint32_t pgn = message()->pgn();
+
+  CanMessagePtr msg(
+    {
+      static_cast<uint8_t>(ETP_DPO), 
+      static_cast<uint8_t>(_range.second - _range.first),
+      static_cast<uint8_t>(_dpo_offset & 0xFF),
+      static_cast<uint8_t>((_dpo_offset >> 8) & 0xFF),
+      static_cast<uint8_t>((_dpo_offset >> 16) & 0xFF),
+      static_cast<uint8_t>(pgn & 0xFF),
+      static_cast<uint8_t>((pgn >> 8) & 0xFF),
+      static_cast<uint8_t>((pgn >> 16) & 0xFF),
+    }, PGN_ETP_CM, 7, cback);
+
+  return processor()->send_can_message(msg, local(), remote(), bus());
+}
+
+/**
+ * \fn  TxSession::make_dt_id
+ *
+ *  DT identifier from the current addresses of both ECUs, the
+ *  generation is read first so a later change is always noticed
+ *
+ * @return  uint32_t
+ */
+uint32_t TxSession::make_dt_id()
+{
+  _generation = processor()->device_db().generation();
+
+  uint8_t sa = source_ecu()->get_address(bus());
+  uint8_t da = is_broadcast() ? BROADCAST_CAN_ADDRESS : destination_ecu()->get_address(bus());
+  return CanPacket::make_id(dt_pgn(), da, sa, 7);
+}
+
+/**
+ * \fn  TxSession::addresses_current
+ *
+ *  False once either ECU lost or changed its address since _dt_id
+ *  was built, DT frames would go out under stale addresses
+ *
+ * @return  bool
+ */
+bool TxSession::addresses_current()
+{
+  if (processor()->device_db().generation() == _generation)
+    return true;
+
+  uint32_t dt_id = make_dt_id();
+  return (dt_id == _dt_id);
+}
+
+/**
+ * \fn  TxSession::send_next_data
+ *
+ *  Keeps up to LibraryConfig::_tp_tx_window packets of the current
+ *  range in flight, confirmations are reconciled in on_data_confirm.
+ *  The packets go to the driver in batches of MAX_TP_TX_BATCH with
+ *  a single confirmation for the last one. BAM still sends one packet
+ *  per BAM_TP_MINIMUM_TIMEOUT.
+ */
+void TxSession::send_next_data()
+{
+  uint32_t window = static_cast<uint32_t>(std::max<size_t>(can_library_config()._tp_tx_window, 1));
+
+  _sending = true;
+  while ((_current < _range.second) && ((_current - _confirmed) < window))
+  {
+    if (!addresses_current())
+    {
+      abort(AbortIgnoreMessage);
+      break;
+    }
+
+    if (is_broadcast() && ((processor()->get_time_tick() - _time_tag) < BAM_TP_MINIMUM_TIMEOUT))
+      break;
+
+    _time_tag = processor()->get_time_tick();
+
+    std::array<CanPacket,MAX_TP_TX_BATCH> packets;
+    size_t count = 0;
+    uint32_t limit = is_broadcast() ? (_current + 1) : std::min(_range.second, _confirmed + window);
+    while ((_current < limit) && (count < packets.size()))
+      packets[count++] = data_packet(_current++);
+
+    auto me = dynamic_shared_cast<TxSession>(getptr());
+    uint32_t batch = _batch;
+    uint32_t last = _current;
+    if (!processor()->send_raw_packets(packets.data(), count, bus(), 
+                  [me, this, batch, last](uint64_t,CanMessageConfirmation confirm)
+    /// Lambda begin
+          {
+            std::lock_guard<Mutex>   l(*(me->_mutex));
+            on_data_confirm(batch, last, confirm == eMessageSent);
+            arm();
+          }))
+    /// Lambda end
+    {
+      _state = None;
+      break;
+    }
+
+    if (is_broadcast() || (_state == None))
+      break;
+  }
+  _sending = false;
+
+  if ((_state == None) || (_confirmed >= _range.second))
+    return;
+
+  if ((_current < _range.second) && ((_current - _confirmed) < window))
+    _state = SendData;
+  else
+    _state = WaitDriverConfirmation;
+}
+
+/**
+ * \fn  TxSession::on_data_confirm
+ *
+ *  The driver sends in order, so the confirmation of a batch covers
+ *  all packets before it
+ *
+ * @param  batch : uint32_t range the packets were sent for
+ * @param  last : uint32_t one past the last confirmed packet
+ * @param  success : bool
+ */
+void TxSession::on_data_confirm(uint32_t batch, uint32_t last, bool success)
+{
+  if ((batch != _batch) || (_state == None))
+    return;
+
+  if (!success)
+  {
+    _state = None;
+    return;
+  }
+
+  _confirmed = std::max(_confirmed, last);
+  if (_confirmed < _range.second)
+  {
+    // Part of the window got free
+    if (!_sending && (_state == WaitDriverConfirmation))
+      send_next_data();
+    return;
+  }
+
+  _time_tag = processor()->get_time_tick();
+  if (is_broadcast())
+    _state = None;
+  else
+  {
+    _timeout_value = TRANSPORT_TIMEOUT_T3;
+    if (_current < num_packets())
+      _state = WaitCTS;
+    else
+      _state = WaitEOM;
+  }
+}
+
+/**
+ * \fn  TxSession::on_cts
+ *
+ * @param  packet : const CanPacket& 
+ */
+void TxSession::on_cts(const CanPacket& packet)
+{
+  uint32_t pgn = packet.data()[5] | (packet.data()[6] << 8) | (packet.data()[7] << 16);
+  if (pgn != message()->pgn())
+  {
+    abort(AbortDuplicateConnection);
+    return;
+  }
+
+  uint32_t count = packet.data()[1];
+  uint32_t next_packet = packet.data()[2];
+  if (is_extended())
+    next_packet |= (packet.data()[3] << 8) | (packet.data()[4] << 16);
+
+  if (count == 0)
+  {
+    // Receiver is stalling transmission, pending confirmations
+    // must not move the session out of waiting
+    _time_tag = processor()->get_time_tick();
+    _timeout_value = TRANSPORT_TIMEOUT_T4;
+    _batch++;
+    _state = WaitCTS;
+    return;
+  }
+
+  if ((next_packet == 0) || (next_packet > num_packets()))
+  {
+    abort(AbortBadSequenceNumber);
+    return;
+  }
+
+  if (!addresses_current())
+  {
+    abort(AbortIgnoreMessage);
+    return;
+  }
+
+  _range.first = next_packet - 1;
+  _range.second = std::min(_range.first + count, num_packets());
+  _current = _range.first;
+  _confirmed = _range.first;
+  _dpo_offset = _range.first;
+  _batch++;
+  _state = is_extended() ? SendDPO : SendData;
 }
 
 /**
@@ -103,30 +339,33 @@ void TxSession::update()
   {
   case SendBAM:
     {
-      uint16_t total_size = static_cast<uint16_t>(message()->length());
-      uint8_t  num_packets = static_cast<uint8_t>((total_size - 1) / 7 + 1);
-
       _time_tag = processor()->get_time_tick();
       _state = WaitDriverConfirmation;
 
       auto me = dynamic_shared_cast<TxSession>(getptr());
-      if (!send_bam([me, num_packets, this](uint64_t,const ConstantString& bus_name,bool success)
+      uint32_t batch = ++_batch;
+      if (!send_bam([me, this, batch](uint64_t,const ConstantString&,bool success)
       /// Lambda begin
             {
               std::lock_guard<Mutex>   l(*(me->_mutex));
-              if (me->_state != WaitDriverConfirmation) 
+              if ((me->_state != WaitDriverConfirmation) || (batch != _batch))
                 return;
 
               if (success)
               {
-                _range.first = static_cast<uint8_t>(0);
-                _range.second = num_packets;
+                _range.first = 0;
+                _range.second = num_packets();
+                _current = 0;
+                _confirmed = 0;
+                _batch++;
                 _time_tag = me->processor()->get_time_tick();
                 _state = SendData; 
                 update();
               }   
               else
                 _state = None;
+
+              arm();
             }))
       /// Lambda end
       {
@@ -136,85 +375,66 @@ void TxSession::update()
     break;
 
   case SendData:
-    {
-      if (is_broadcast())
-      {
-        if ((processor()->get_time_tick() - _time_tag) < BAM_TP_MINIMUM_TIMEOUT)
-          break;
-      }
+    send_next_data();
+    break;
 
+  case SendRTS:
+    {
       _time_tag = processor()->get_time_tick();
       _state = WaitDriverConfirmation;
 
       auto me = dynamic_shared_cast<TxSession>(getptr());
-      if (!send_data(_current, [me, this](uint64_t,const ConstantString& bus_name,bool success)
+      uint32_t batch = ++_batch;
+      if (!send_rts([me, this, batch](uint64_t,const ConstantString&,bool success)
       /// Lambda begin
             {
               std::lock_guard<Mutex>   l(*(me->_mutex));
-              if (me->_state != WaitDriverConfirmation) 
+              if ((me->_state != WaitDriverConfirmation) || (batch != _batch))
                 return;
 
-              // Callback for message sent
               if (success)
               {
-                _state = SendData;
-                _time_tag = processor()->get_time_tick();
-
-                if (++_current >= _range.second)
-                {
-                  if (is_broadcast())
-                    _state = None;
-                  else
-                  {
-                    uint16_t total_size = static_cast<uint16_t>(message()->length());
-                    uint8_t  num_packets = static_cast<uint8_t>((total_size - 1) / 7 + 1);
-                    
-                    _time_tag = processor()->get_time_tick();
-                    _timeout_value = TRANSPORT_TIMEOUT_T3;
-
-                    if (_current < num_packets)
-                      _state = WaitCTS;
-                    else
-                      _state = WaitEOM;
-                  }
-                }
+                _time_tag = me->processor()->get_time_tick();
+                _timeout_value = TRANSPORT_TIMEOUT_T3;
+                _state = WaitCTS;
                 update();
               }
               else
                 me->_state = None;
+
+              arm();
             }))
       /// Lambda end
       {
         _state = None;
       }
-      else
-      {
-      }
     }
     break;
 
-  case SendRTS:
+  case SendDPO:
     {
       _time_tag = processor()->get_time_tick();
       _state = WaitDriverConfirmation;
 
       auto me = dynamic_shared_cast<TxSession>(getptr());
-      if (!send_rts([me, this](uint64_t,const ConstantString& bus_name,bool success)
+      uint32_t batch = ++_batch;
+      if (!send_dpo([me, this, batch](uint64_t,const ConstantString&,bool success)
       /// Lambda begin
             {
               std::lock_guard<Mutex>   l(*(me->_mutex));
-              if (me->_state != WaitDriverConfirmation) 
+              if ((me->_state != WaitDriverConfirmation) || (batch != _batch))
                 return;
 
               if (success)
               {
                 _time_tag = me->processor()->get_time_tick();
-                _timeout_value = TRANSPORT_TIMEOUT_T3;
-                _state = WaitCTS;
+                _state = SendData;
                 update();
               }
               else
                 me->_state = None;
+
+              arm();
             }))
       /// Lambda end
       {
@@ -240,99 +460,70 @@ void TxSession::update()
 }
 
 /**
- * \fn  TxSession::pgn_received
+ * \fn  TxSession::deadline
  *
- * @param  packet : const CanPacket& 
+ * @return  uint64_t
  */
-void TxSession::pgn_received(const CanPacket& packet)
+uint64_t TxSession::deadline() const
 {
   switch (_state)
   {
   case SendData:
-    {
-      if (is_broadcast())
-      {
-        if ((processor()->get_time_tick() - _time_tag) < BAM_TP_MINIMUM_TIMEOUT)
-          break;
-      }
+    return is_broadcast() ? (_time_tag + BAM_TP_MINIMUM_TIMEOUT) : 0;
 
-      _time_tag = processor()->get_time_tick();
-      _state = WaitDriverConfirmation;
+  case WaitEOM:
+  case WaitCTS:
+    return _time_tag + _timeout_value + 1;
 
-      auto me = dynamic_shared_cast<TxSession>(getptr());
+  case WaitDriverConfirmation:
+    return _time_tag + 1000;
 
-      if (!send_data(_current, [me, this](uint64_t,const ConstantString& bus_name,bool success)
-      /// Lambda begin
-            {
-              std::lock_guard<Mutex>   l(*(me->_mutex));
-              if (me->_state != WaitDriverConfirmation) 
-                return;
+  default:
+    // Sends and completion are due right away
+    return 0;
+  }
+}
 
-              // Callback for message sent
-              if (success)
-              {
-                _state = SendData;
-                _time_tag = processor()->get_time_tick();
-                
-                if (++_current >= _range.second)
-                {
-                  if (is_broadcast())
-                    _state = None;
-                  else
-                  {
-                    uint16_t total_size = static_cast<uint16_t>(message()->length());
-                    uint8_t  num_packets = static_cast<uint8_t>((total_size - 1) / 7 + 1);
-                    
-                    _timeout_value = TRANSPORT_TIMEOUT_T3;
-                    if (_current < num_packets)
-                      _state = WaitCTS;
-                    else
-                      _state = WaitEOM;
-                  }
-                }
-                update();
-              }
-              else
-                me->_state = None;
-            }))
-      /// Lambda end
-      {
-        _state = None;
-      }
-      else
-      {
-      }
-    }
+/**
+ * \fn  TxSession::pgn_received
+ *
+ * @param  packet : const CanPacket& 
+ */
+void TxSession::pgn_received(const CanPacket& packet)
+{
+  uint8_t control = packet.data()[0];
+  switch (_state)
+  {
+  case SendData:
+    send_next_data();
     break;
+
+  case WaitDriverConfirmation:
+    if (is_broadcast())
+      break;
+
+    // A CTS is only taken once every data packet of the current range
+    // went to the driver, with several packets in flight the receiver
+    // may answer before the driver confirmed all of them. Before the
+    // first CTS only the RTS can be pending: an early CTS proves it
+    // went out, and moving _batch on drops its late confirmation.
+    if ((_range.second != 0) && (_current < _range.second))
+      break;
+    // fall through
+
   case WaitCTS:
   case WaitEOM:
     { 
-      if (packet.data()[0] == CTS)
+      if (control == (is_extended() ? ETP_CTS : CTS))
       {
-        uint32_t pgn = packet.data()[5] | (packet.data()[6] << 8) | (packet.data()[7] << 8);
-        if (pgn != message()->pgn())
-        {
-          abort(AbortDuplicateConnection);
-          break;
-        }
-
-        uint8_t num_packets = packet.data()[1];
-        if (num_packets == 0)
-        {
-          // Receiver is stalling transmission
-          _time_tag = processor()->get_time_tick();
-          _timeout_value = TRANSPORT_TIMEOUT_T4;
-        }
-        else
-        {
-          uint8_t next_packet = packet.data()[2];
-          _range.first = static_cast<uint8_t>(num_packets);
-          _range.second = static_cast<uint8_t>(num_packets + next_packet);
-          _state = SendData;
-        }
+        on_cts(packet);
+        if ((_state == SendData) || (_state == SendDPO))
+          update();
       }
-      else if ((packet.data()[0] == Abort) || ((packet.data()[0] == EOM) && (_state == WaitEOM)))
+      else if ((control == Abort) || (control == (is_extended() ? ETP_EOM : EOM)))
       {
+        // A CTS for a gap leaves us waiting for the next CTS,
+        // the receiver may be complete by then
         _state = None;
       }
     }
@@ -366,10 +557,10 @@ void TxSession::operator delete  ( void* ptr )
  * @param   message :  const CanMessagePtr&
  * @param   source :  const CanECUPtr&
  * @param   destination : const CanECUPtr&
- * @param   bus_name : const ConstantString&
+ * @param   bus : CanBusHandle
  */
 TxSessionPtr::TxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanMessagePtr& message,
-                                  const CanECUPtr& source,const CanECUPtr& destination,const ConstantString& bus_name)
+                                  const CanECUPtr& source,const CanECUPtr& destination,CanBusHandle bus)
 {
   if (TxSession::_allocator == nullptr)
     throw std::runtime_error("Library is not properly initialized");
@@ -378,7 +569,7 @@ TxSessionPtr::TxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanMessa
   if (session == nullptr)
     session = reinterpret_cast<TxSession*>(::malloc(sizeof(TxSession)));
 
-  ::new (session) TxSession(processor, mutex, message, source, destination, bus_name);
+  ::new (session) TxSession(processor, mutex, message, source, destination, bus);
   reset(session);
 }
 
@@ -34,14 +34,17 @@ friend bool can_library_release();
    * @param   message : const CanMessagePtr&
    * @param   source : const CanECUPtr&
    * @param   destination :  const CanECUPtr&
-   * @param   bus_name : const ConstantString&
+   * @param   bus : CanBusHandle
    */
   TxSession(CanProcessor* processor, Mutex* mutex,const CanMessagePtr& message,const CanECUPtr& source,
-                    const CanECUPtr& destination,const ConstantString& bus_name)
-  : TransportSession(processor, mutex, message,  source, destination, bus_name)
-  , _range(), _current(0), _time_tag(0), _timeout_value(0)
+                    const CanECUPtr& destination,CanBusHandle bus)
+  : TransportSession(processor, mutex, message,  source, destination, bus)
+  , _range(), _current(0), _confirmed(0), _batch(0), _sending(false)
+  , _dpo_offset(0), _dt_id(0), _generation(0), _time_tag(0), _timeout_value(0)
   {
+    _extended = (message->length() > MAX_TP_DATA_SIZE);
     _state = (is_broadcast()) ? SendBAM : SendRTS;
+    _dt_id = make_dt_id();
   }
 
 public:
@@ -54,14 +57,24 @@ public:
   virtual void                    pgn_received(const CanPacket& packet);
   virtual bool                    is_complete() const  { return (_state == None); }
   virtual void                    on_abort() { _state = None; }
+  virtual uint64_t                deadline() const;
+
+          uint32_t                num_packets() const { return (message()->length() - 1) / 7 + 1; }
 
           bool                    send_bam(CanMessage::ConfirmationCallback = CanMessage::ConfirmationCallback());
-          bool                    send_data(uint8_t sequence, CanMessage::ConfirmationCallback = CanMessage::ConfirmationCallback());
+          CanPacket               data_packet(uint32_t packet) const;
           bool                    send_rts( CanMessage::ConfirmationCallback = CanMessage::ConfirmationCallback());
+          bool                    send_dpo( CanMessage::ConfirmationCallback = CanMessage::ConfirmationCallback());
 
           void operator delete  ( void* ptr );
 
 private:
+          uint32_t                make_dt_id();
+          bool                    addresses_current();
+          void                    send_next_data();
+          void                    on_data_confirm(uint32_t batch, uint32_t last, bool success);
+          void                    on_cts(const CanPacket& packet);
+
   static allocator<TxSession>*    _allocator;
 
   enum TxStates
@@ -69,14 +82,26 @@ private:
     SendBAM,
     SendData,
     SendRTS,
+    SendDPO,
     WaitCTS,
     WaitEOM,
     WaitDriverConfirmation,
     None
   }                               _state;
 
-  range                           _range;
+  // Absolute packet range [first,second) of the current CTS window,
+  // _current is the next packet to send and the driver confirmed
+  // the packets up to _confirmed. _batch tells confirmations of an
+  // earlier range or of an earlier BAM, RTS or DPO frame apart.
+  std::pair<uint32_t,uint32_t>    _range;
   uint32_t                        _current;
+  uint32_t                        _confirmed;
+  uint32_t                        _batch;
+  bool                            _sending;
+  uint32_t                        _dpo_offset;
+  // DT identifier and the device database generation it was built for
+  uint32_t                        _dt_id;
+  uint32_t                        _generation;
   uint64_t                        _time_tag;
   uint64_t                        _timeout_value;
 };
@@ -94,7 +119,7 @@ class TxSessionPtr : public shared_pointer<TxSession>
 public:
   TxSessionPtr() {}
   TxSessionPtr(CanProcessor* processor, Mutex* mutex, const CanMessagePtr& message, const CanECUPtr& source,
-                  const CanECUPtr& destination,const ConstantString& bus_name);
+                  const CanECUPtr& destination,CanBusHandle bus);
 };
 
 } // can